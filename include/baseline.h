@@ -0,0 +1,201 @@
+/*
+ * snapshots of the strings in each file,
+ * for reporting only the strings that were added or removed since
+ */
+#ifndef BASELINE_H
+#define BASELINE_H
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * the number of bytes of each string kept in a baseline,
+ * so that removed strings can be printed:
+ * the first bytes of the string, then its last byte
+ */
+#define STORED_STRING_BYTES	256
+
+/* the number of times that a distinct string appears in a file */
+struct string_tally_entry {
+	/* the hash of the string, including its quotation marks */
+	uint64_t hash;
+	/* the number of appearances, or 0 if the entry is unused */
+	size_t count;
+	/* the first appearance of the string, in the file's buffer */
+	const char *first;
+	/* the length of the string */
+	size_t length;
+	/* the number of the line containing the first appearance */
+	size_t line_number;
+};
+
+/*
+ * the distinct strings in a file, stored in an open-addressed table,
+ * in which strings with the same hash are kept apart
+ */
+struct string_tally {
+	/* the table of entries, whose size is a power of 2 */
+	struct string_tally_entry *entries;
+	/* the number of entries in the table */
+	size_t capacity;
+	/* the number of distinct strings */
+	size_t size;
+};
+
+/*
+ * Create an empty tally.
+ * tally:	the tally to initialize,
+ *		which must later be freed with "destroy_string_tally"
+ *		if this function succeeds
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "calloc"
+ */
+int init_string_tally(struct string_tally *tally);
+/*
+ * Free the memory used by a tally.
+ * tally:	the tally to free
+ */
+void destroy_string_tally(struct string_tally *tally);
+/*
+ * Remove all strings from a tally, so that it can be reused.
+ * tally:	the tally to empty
+ */
+void clear_string_tally(struct string_tally *tally);
+/*
+ * Count an appearance of a string.
+ * The string must stay in memory until the tally is cleared.
+ * tally:	the tally to which to add the string
+ * string:	the string, including its quotation marks
+ * length:	the length of the string
+ * line_number:	the number of the line containing the string
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "calloc"
+ *		   if the table could not be grown
+ */
+int tally_string(struct string_tally *tally, const char *string,
+		 size_t length, size_t line_number);
+
+/* the number of times that a string appeared in a file in the baseline */
+struct string_count {
+	uint64_t hash;		/* the hash of the string */
+	uint64_t count;		/* the number of appearances */
+	uint64_t length;	/* the length of the whole string */
+	/*
+	 * the bytes of the string kept in the baseline,
+	 * up to "STORED_STRING_BYTES", in the file's "literals"
+	 */
+	const char *literal;
+};
+
+/* the strings in a single file in the baseline */
+struct baseline_file {
+	/* the path of the file, relative to the searched directory */
+	char *path;
+	/* the hash of the whole contents of the file */
+	uint64_t content_hash;
+	/* the number of distinct strings in the file */
+	size_t n_strings;
+	/* the counts of the distinct strings, sorted by hash, then text */
+	struct string_count *strings;
+	/* the stored bytes of all the strings, one after another */
+	char *literals;
+	/* Was the file found in the current search? */
+	int visited;
+};
+
+/* the snapshot of the strings in every file, indexed by path */
+struct baseline {
+	/* the files, in the order in which they were added */
+	struct baseline_file *files;
+	/* the number of files */
+	size_t n_files;
+	/* the number of files for which there is room */
+	size_t files_capacity;
+	/* indices into "files", stored in an open-addressed table by path */
+	size_t *index;
+	/* the number of slots in "index", which is a power of 2 */
+	size_t index_capacity;
+};
+
+/*
+ * Create an empty baseline.
+ * baseline:	the baseline to initialize,
+ *		which must later be freed with "destroy_baseline"
+ *		if this function succeeds
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "malloc"
+ */
+int init_baseline(struct baseline *baseline);
+/*
+ * Free the memory used by a baseline.
+ * baseline:	the baseline to free
+ */
+void destroy_baseline(struct baseline *baseline);
+/*
+ * Add a file, and the strings in it, to the baseline.
+ * The tally is left sorted, and should be cleared before reuse.
+ * baseline:		the baseline to which to add the file
+ * path:		the relative path of the file
+ * content_hash:	the hash of the contents of the file
+ * tally:		the strings in the file
+ * returns		0 on success,
+ *			-1 on failure, with errno set by "malloc"
+ */
+int add_baseline_file(struct baseline *baseline, const char *path,
+		      uint64_t content_hash, struct string_tally *tally);
+/*
+ * Find a file in the baseline.
+ * baseline:	the baseline in which to search
+ * path:	the relative path of the file
+ * returns	the file, or NULL if it is not in the baseline
+ */
+struct baseline_file *find_baseline_file(const struct baseline *baseline,
+					 const char *path);
+/*
+ * Save a baseline in its binary format.
+ * baseline:	the baseline to save
+ * out:		the output stream to which to write
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "fwrite"
+ */
+int write_baseline(const struct baseline *baseline, FILE *out);
+/*
+ * Load a baseline saved by "write_baseline".
+ * baseline:	an empty baseline, to which to add the saved files
+ * in:		the input stream from which to read
+ * returns	0 on success,
+ *		-1 on failure, with errno set by
+ *		   "fread" if reading failed,
+ *		   or by "malloc";
+ *		   or if the input is not a baseline
+ */
+int read_baseline(struct baseline *baseline, FILE *in);
+
+/*
+ * Print the strings in a file that were added or removed
+ * since the baseline.
+ * Each added string is printed once, as
+ * "[path] ([line]):\t+[number of new appearances]\t[string]",
+ * with the line of its first appearance.
+ * Each removed string is printed as
+ * "[path]:\t-[number of removed appearances]\t[string]",
+ * If it is longer than "STORED_STRING_BYTES",
+ * the bytes that were not kept are replaced by "[...]".
+ * The tally is left reordered, and should be cleared before reuse.
+ * out:		the output stream to which to print
+ * path:	the relative path of the file
+ * old_file:	the file in the baseline, or NULL if it is new
+ * tally:	the strings now in the file
+ */
+void print_string_changes(FILE *out, const char *path,
+			  const struct baseline_file *old_file,
+			  struct string_tally *tally);
+/*
+ * Print the strings in the baseline files that were not visited,
+ * as removed.
+ * out:		the output stream to which to print
+ * baseline:	the baseline whose files were marked as visited
+ */
+void print_removed_files(FILE *out, const struct baseline *baseline);
+
+#endif /* BASELINE_H */
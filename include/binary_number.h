@@ -0,0 +1,27 @@
+/* unsigned integers in files, stored the same way on every host */
+#ifndef BINARY_NUMBER_H
+#define BINARY_NUMBER_H
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Write an unsigned integer in little-endian order.
+ * out:		the output stream to which to write
+ * value:	the value to write
+ * n_bytes:	the number of bytes of the value to write
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "fwrite"
+ */
+int write_number(FILE *out, uint64_t value, size_t n_bytes);
+/*
+ * Read an unsigned integer in little-endian order.
+ * in:		the input stream from which to read
+ * value:	stores the value
+ * n_bytes:	the number of bytes in the value
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "fread"
+ */
+int read_number(FILE *in, uint64_t *value, size_t n_bytes);
+
+#endif /* BINARY_NUMBER_H */
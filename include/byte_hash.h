@@ -0,0 +1,18 @@
+/* a fast, stable hash of byte strings */
+#ifndef BYTE_HASH_H
+#define BYTE_HASH_H
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Hash a range of bytes.
+ * The hash only depends on the bytes,
+ * so it can be stored, and compared between runs and hosts.
+ * It is not resistant to deliberate collisions.
+ * bytes:	the bytes to hash
+ * length:	the number of bytes to hash
+ * returns	the 64-bit hash
+ */
+uint64_t hash_bytes(const void *bytes, size_t length);
+
+#endif /* BYTE_HASH_H */
@@ -0,0 +1,98 @@
+/*
+ * choosing how each file is read and scanned, by its size,
+ * with thresholds measured on this machine and cached in a file
+ */
+#ifndef ENGINE_H
+#define ENGINE_H
+#include <scan_kernels.h>
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* the thresholds choosing how each file is read and scanned */
+struct engine_thresholds {
+	/*
+	 * the smallest file, in bytes, that is mapped with "mmap"
+	 * rather than copied with "read", or UINT64_MAX to always copy
+	 */
+	uint64_t min_mmap_size;
+	/*
+	 * the smallest file, in bytes, that is scanned with the kernels
+	 * at "vector_level", rather than one byte at a time
+	 */
+	uint64_t min_vector_size;
+	/* the kernels for files of at least "min_vector_size" bytes */
+	enum scan_kernel_level vector_level;
+};
+
+/*
+ * Get the name of a set of kernels,
+ * as used in the configuration and on the command line.
+ * level:	the set of kernels
+ * returns	the name, such as "avx2"
+ */
+const char *kernel_level_name(enum scan_kernel_level level);
+/*
+ * Find a set of kernels by its name.
+ * name:	the name, as returned by "kernel_level_name"
+ * level:	stores the set of kernels
+ * returns	0 on success, -1 if the name is unknown
+ */
+int parse_kernel_level(const char *name, enum scan_kernel_level *level);
+
+/*
+ * Fill in the thresholds used without calibration,
+ * which always read files with "read",
+ * and scan them with the widest supported kernels.
+ * thresholds:	stores the thresholds
+ */
+void default_engine_thresholds(struct engine_thresholds *thresholds);
+/*
+ * Measure the thresholds on this machine, with a short benchmark
+ * of each way of reading a temporary file of several sizes,
+ * and of each set of kernels on text of several sizes.
+ * thresholds:	stores the thresholds
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "tmpfile", "write",
+ *		   "malloc", "read" or "mmap"
+ */
+int calibrate_engine(struct engine_thresholds *thresholds);
+/*
+ * Save thresholds as text, one "[name] [value]" per line,
+ * with the widest kernels supported when they were measured.
+ * thresholds:	the thresholds to save
+ * out:		the output stream to which to write
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "fprintf"
+ */
+int write_engine_config(const struct engine_thresholds *thresholds,
+			FILE *out);
+/*
+ * Load thresholds saved by "write_engine_config".
+ * thresholds:	stores the thresholds, only if they are all valid
+ * in:		the input stream from which to read
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "fgets",
+ *		   or to EINVAL if the input is not a valid configuration,
+ *		   or was measured with different kernels than are now
+ *		   supported, as when it was copied from another machine
+ */
+int read_engine_config(struct engine_thresholds *thresholds, FILE *in);
+/*
+ * Load the thresholds cached in a file,
+ * or measure them and save them to the file if it is missing or stale,
+ * creating the directories containing it if they are missing.
+ * If the file cannot be written, as when the home directory is read-only,
+ * the defaults are used without measuring anything.
+ * Failing to measure the thresholds, as when no temporary file can be
+ * created, is only a warning, after which the defaults are used,
+ * and failing to save them is only a warning too.
+ * thresholds:	stores the thresholds
+ * config_path:	the path of the file
+ * measure:	Measure the thresholds if they are not cached,
+ *		rather than using the defaults?
+ */
+void load_engine_thresholds(struct engine_thresholds *thresholds,
+			    const char *config_path, int measure);
+
+#endif /* ENGINE_H */
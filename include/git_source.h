@@ -0,0 +1,90 @@
+/*
+ * reading the files of a git repository straight from its object store,
+ * either every file in a revision, or only the files changed
+ * between two revisions, without checking them out
+ */
+#ifndef GIT_SOURCE_H
+#define GIT_SOURCE_H
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* the files of a revision, being read one after another */
+struct git_source {
+	/* the process listing the files, "git ls-tree" or "git diff-tree" */
+	pid_t list_pid;
+	/* the list of files, each record terminated by '\0' */
+	FILE *list;
+	/* Is the list of files a list of changes, from "git diff-tree"? */
+	int is_diff;
+	/* the process reading the blobs, "git cat-file --batch" */
+	pid_t batch_pid;
+	/* the stream to which to write the names of the blobs to read */
+	FILE *batch_in;
+	/* the stream from which to read the blobs */
+	FILE *batch_out;
+	/* the current record of the list */
+	char *record;
+	/* the number of bytes allocated for "record" */
+	size_t record_capacity;
+	/* the path of the current file, for a list of changes */
+	char *path;
+	/* the number of bytes allocated for "path" */
+	size_t path_capacity;
+	/* the header of the current blob, from "git cat-file" */
+	char *header;
+	/* the number of bytes allocated for "header" */
+	size_t header_capacity;
+};
+
+/*
+ * Start listing the files of a revision.
+ * Only regular files are listed; symbolic links and submodules are not.
+ * source:	the list to initialize,
+ *		which must later be freed with "close_git_source"
+ *		if this function succeeds
+ * repo_path:	the path of the repository, or of a directory inside it
+ * base_rev:	the revision against which to compare, so that only
+ *		the files added or changed since then are listed,
+ *		or NULL to list every file
+ * rev:		the revision whose files to list
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "pipe" or "posix_spawnp"
+ */
+int open_git_source(struct git_source *source, const char *repo_path,
+		    const char *base_rev, const char *rev);
+/*
+ * Find the next file, and start reading its contents,
+ * which must then be read with "read_git_blob".
+ * source:	the list of files
+ * path:	stores the path of the file, relative to the repository,
+ *		which is valid until the next call
+ * size:	stores the number of bytes in the file
+ * returns	1 if a file was found,
+ *		0 at the end of the list,
+ *		-1 on failure, with errno set by "getdelim" or "fflush",
+ *		   which sets it to EPIPE if git has stopped,
+ *		   or to EPROTO if git's output could not be understood
+ */
+int next_git_blob(struct git_source *source, const char **path,
+		  size_t *size);
+/*
+ * Read the contents of the file found by "next_git_blob".
+ * source:	the list of files
+ * data:	stores the contents of the file
+ * size:	the number of bytes in the file, as found by "next_git_blob"
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "fread",
+ *		   or to EPROTO if the contents ended early
+ */
+int read_git_blob(struct git_source *source, char *data, size_t size);
+/*
+ * Stop listing files, and wait for git to finish.
+ * source:	the list to free
+ * returns	0 if git succeeded,
+ *		-1 if git failed, or was stopped before the end of the list,
+ *		   with errno set by "waitpid", or to ECHILD
+ */
+int close_git_source(struct git_source *source);
+
+#endif /* GIT_SOURCE_H */
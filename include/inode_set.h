@@ -0,0 +1,51 @@
+/* a compact hash set of files, identified by their device and inode */
+#ifndef INODE_SET_H
+#define INODE_SET_H
+#include <stddef.h>
+#include <sys/types.h>
+
+/* the identity of a file, which is shared by all of its paths */
+struct inode_key {
+	dev_t device;	/* the device containing the file */
+	ino_t inode;	/* the inode number of the file on the device */
+};
+
+/* a set of files, stored in an open-addressed table */
+struct inode_set {
+	/* the table of keys, whose size is a power of 2 */
+	struct inode_key *keys;
+	/* Is the slot with the same index in "keys" in use? */
+	unsigned char *used;
+	/* the number of slots in the table */
+	size_t capacity;
+	/* the number of keys in the set */
+	size_t size;
+};
+
+/*
+ * Create an empty set.
+ * set:		the set to initialize,
+ *		which must later be freed with "destroy_inode_set"
+ *		if this function succeeds
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "calloc"
+ */
+int init_inode_set(struct inode_set *set);
+/*
+ * Free the memory used by a set.
+ * set:		the set to free
+ */
+void destroy_inode_set(struct inode_set *set);
+/*
+ * Add a file to a set, if it is not already there.
+ * set:		the set to which to add the file
+ * device:	the device containing the file
+ * inode:	the inode number of the file
+ * returns	1 if the file was added,
+ *		0 if the file was already in the set,
+ *		-1 on failure, with errno set by "calloc"
+ *		   if the table could not be grown
+ */
+int add_inode(struct inode_set *set, dev_t device, ino_t inode);
+
+#endif /* INODE_SET_H */
@@ -0,0 +1,124 @@
+/*
+ * an on-disk index of the strings found in a search,
+ * for answering substring queries without searching again
+ */
+#ifndef LITERAL_INDEX_H
+#define LITERAL_INDEX_H
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* an appearance of a string in a file */
+struct index_location {
+	uint32_t file_id;	/* the index of the file in the index */
+	uint32_t line_number;	/* the line containing the string */
+};
+
+/* an appearance of a string, while the index is being built */
+struct index_occurrence {
+	uint32_t literal_id;		/* the distinct string */
+	struct index_location location;	/* where it appeared */
+};
+
+/* the strings collected so far, to be written as an index */
+struct index_builder {
+	/* the paths of the files, each terminated by '\0' */
+	char *file_pool;
+	/* the number of bytes used in "file_pool" */
+	size_t file_pool_size;
+	/* the number of bytes allocated for "file_pool" */
+	size_t file_pool_capacity;
+	/* the offset in "file_pool" of each file */
+	uint64_t *file_offsets;
+	/* the number of files */
+	size_t n_files;
+	/* the number of files for which there is room */
+	size_t files_capacity;
+
+	/* the distinct strings, one after another */
+	char *literal_pool;
+	/* the number of bytes used in "literal_pool" */
+	size_t literal_pool_size;
+	/* the number of bytes allocated for "literal_pool" */
+	size_t literal_pool_capacity;
+	/* the offset in "literal_pool" of each string, and its end */
+	uint64_t *literal_offsets;
+	/* the hash of each distinct string */
+	uint64_t *literal_hashes;
+	/* the number of distinct strings */
+	size_t n_literals;
+	/* the number of distinct strings for which there is room */
+	size_t literals_capacity;
+	/* string indices, stored in an open-addressed table by hash */
+	uint32_t *literal_table;
+	/* the number of slots in "literal_table", a power of 2 */
+	size_t literal_table_capacity;
+
+	/* every appearance of every string, in the order found */
+	struct index_occurrence *occurrences;
+	/* the number of appearances */
+	size_t n_occurrences;
+	/* the number of appearances for which there is room */
+	size_t occurrences_capacity;
+};
+
+/*
+ * Create an empty index.
+ * builder:	the index to initialize,
+ *		which must later be freed with "destroy_index_builder"
+ *		if this function succeeds
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "malloc"
+ */
+int init_index_builder(struct index_builder *builder);
+/*
+ * Free the memory used by an index.
+ * builder:	the index to free
+ */
+void destroy_index_builder(struct index_builder *builder);
+/*
+ * Start adding the strings of another file.
+ * builder:	the index to which to add the file
+ * path:	the path of the file, as it should be printed
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "realloc",
+ *		   or to EOVERFLOW if the index is full
+ */
+int add_index_file(struct index_builder *builder, const char *path);
+/*
+ * Add an appearance of a string in the last added file.
+ * builder:	the index to which to add the string
+ * string:	the string, including its quotation marks
+ * length:	the length of the string
+ * line_number:	the number of the line containing the string
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "realloc" or "malloc",
+ *		   or to EOVERFLOW if the index is full
+ */
+int add_index_string(struct index_builder *builder, const char *string,
+		     size_t length, size_t line_number);
+/*
+ * Write the index, with a list of the strings containing each
+ * three-byte sequence, in a format that can be mapped into memory.
+ * builder:	the index to write
+ * out:		the output stream to which to write
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "malloc" or "fwrite"
+ */
+int write_index(const struct index_builder *builder, FILE *out);
+
+/*
+ * Print every appearance of every string in an index
+ * that contains a substring, in the same format as "find_strings".
+ * Only the strings containing all three-byte sequences of the substring
+ * are checked.
+ * out:		the output stream to which to print
+ * index_path:	the path to the index written by "write_index"
+ * substring:	the substring to find
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "open" or "mmap",
+ *		   or to EINVAL if the file is not an index
+ */
+int query_index(FILE *out, const char *index_path, const char *substring);
+
+#endif /* LITERAL_INDEX_H */
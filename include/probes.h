@@ -0,0 +1,43 @@
+/*
+ * static tracepoints, for attaching tracers such as bpftrace or perf
+ * to a running search, as in the scripts in "tools".
+ * With <sys/sdt.h> from SystemTap, each probe is a single "nop",
+ * and its location and arguments are recorded in an ELF note.
+ * Otherwise, or if "NO_PROBES" is defined, the probes compile to nothing.
+ * The arguments of the probes are evaluated even if no tracer is
+ * attached, so they should be cheap, like variables.
+ */
+#ifndef PROBES_H
+#define PROBES_H
+
+#if !defined(NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define HAVE_PROBES
+#endif
+#endif
+
+/* the name of the provider of the probes, for the tracers */
+#define PROBE_PROVIDER	string_finder
+
+#ifdef HAVE_PROBES
+#define PROBE0(name) \
+	DTRACE_PROBE(PROBE_PROVIDER, name)
+#define PROBE1(name, arg1) \
+	DTRACE_PROBE1(PROBE_PROVIDER, name, arg1)
+#define PROBE2(name, arg1, arg2) \
+	DTRACE_PROBE2(PROBE_PROVIDER, name, arg1, arg2)
+#define PROBE3(name, arg1, arg2, arg3) \
+	DTRACE_PROBE3(PROBE_PROVIDER, name, arg1, arg2, arg3)
+#else
+#define PROBE0(name) \
+	((void) 0)
+#define PROBE1(name, arg1) \
+	((void) (arg1))
+#define PROBE2(name, arg1, arg2) \
+	((void) (arg1), (void) (arg2))
+#define PROBE3(name, arg1, arg2, arg3) \
+	((void) (arg1), (void) (arg2), (void) (arg3))
+#endif
+
+#endif /* PROBES_H */
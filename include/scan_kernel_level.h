@@ -0,0 +1,20 @@
+/* the sets of scanning kernels, which a search can be forced to use */
+#ifndef SCAN_KERNEL_LEVEL_H
+#define SCAN_KERNEL_LEVEL_H
+
+/*
+ * the sets of kernels, from the narrowest to the widest,
+ * each giving the same results
+ */
+enum scan_kernel_level {
+	/* one byte at a time */
+	SCALAR_KERNELS,
+	/* 16 bytes at a time */
+	SSE2_KERNELS,
+	/* 32 bytes at a time, except for UTF-8 */
+	AVX2_KERNELS,
+	/* the number of levels */
+	N_KERNEL_LEVELS
+};
+
+#endif /* SCAN_KERNEL_LEVEL_H */
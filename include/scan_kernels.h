@@ -0,0 +1,71 @@
+/* vectorized byte searching and counting over in-memory text */
+#ifndef SCAN_KERNELS_H
+#define SCAN_KERNELS_H
+#include <scan_kernel_level.h>
+
+#include <stddef.h>
+
+/*
+ * Find the first byte in a range that matches either of two values,
+ * in the manner of "memchr", but for two needles at once.
+ * start:	the first byte to check
+ * end:		the end of the range, which will not be checked
+ * first:	the first value to look for
+ * second:	the second value to look for
+ * returns	the position of the first matching byte,
+ *		or "end" if there is none
+ */
+const char *find_either_byte(const char *start, const char *end,
+			     char first, char second);
+/*
+ * Count the bytes in a range that match a value.
+ * start:	the first byte to check
+ * end:		the end of the range, which will not be checked
+ * target:	the value to count
+ * returns	the number of matching bytes
+ */
+size_t count_byte(const char *start, const char *end, char target);
+
+/*
+ * Check that a range only contains printable ASCII characters
+ * and whitespace, as judged by "isprint" and "isspace" in the C locale.
+ * start:	the first byte to check
+ * end:		the end of the range, which will not be checked
+ * returns	1 if all bytes are text, 0 otherwise
+ */
+int is_ascii_text(const char *start, const char *end);
+/*
+ * Check that a range is valid UTF-8,
+ * and contains no control characters other than whitespace.
+ * start:	the first byte to check
+ * end:		the end of the range, which will not be checked
+ * returns	1 if the range is valid UTF-8 text, 0 otherwise
+ */
+int is_utf8_text(const char *start, const char *end);
+
+/*
+ * a set of kernels, with the same arguments as the functions above,
+ * which are the set at "SSE2_KERNELS"
+ */
+struct scan_kernels {
+	const char *(*find_either_byte)(const char *start, const char *end,
+					char first, char second);
+	size_t (*count_byte)(const char *start, const char *end,
+			     char target);
+	int (*is_ascii_text)(const char *start, const char *end);
+	int (*is_utf8_text)(const char *start, const char *end);
+};
+
+/*
+ * Get a set of kernels, if this build and this CPU support it.
+ * level:	the set to get
+ * returns	the kernels, or NULL if they are not supported
+ */
+const struct scan_kernels *get_scan_kernels(enum scan_kernel_level level);
+/*
+ * Find the widest set of kernels that is supported.
+ * returns	the level of the widest supported set
+ */
+enum scan_kernel_level best_scan_kernel_level(void);
+
+#endif /* SCAN_KERNELS_H */
@@ -0,0 +1,120 @@
+/*
+ * splitting a search between several processes,
+ * and merging their outputs back together
+ */
+#ifndef SHARD_H
+#define SHARD_H
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * the byte starting the line that begins the output of each file
+ * in a shard's output, followed by the file's position in the traversal.
+ * It is a control character, so it never appears in the output for text.
+ */
+#define SHARD_RECORD_MARKER	'\x1e'
+/*
+ * the largest number of shards into which a search can be split,
+ * which bounds the memory and time taken to balance them
+ */
+#define MAX_N_SHARDS		1024
+
+/*
+ * Print the line that begins the output of a file in a shard's output.
+ * out:		the output stream of the shard
+ * ordinal:	the position of the file in the traversal, counting from 0
+ */
+void print_shard_record(FILE *out, size_t ordinal);
+
+/*
+ * Choose the shard that will search a file,
+ * based only on its path.
+ * relative_path:	the path of the file, relative to the searched path
+ * n_shards:		the number of shards
+ * returns		the index of the shard, from 0 to "n_shards" - 1
+ */
+unsigned shard_of_path(const char *relative_path, unsigned n_shards);
+
+/* a file to assign to a shard, based on its size */
+struct planned_file {
+	/* the hash of the path of the file, relative to the searched path */
+	uint64_t path_hash;
+	/* the size of the file in bytes */
+	uint64_t size;
+	/* the index of the shard assigned to the file */
+	unsigned shard_index;
+};
+
+/* the assignment of files to shards, balanced by their total sizes */
+struct shard_plan {
+	/* the files, sorted by path hash once the plan is made */
+	struct planned_file *files;
+	/* the number of files */
+	size_t n_files;
+	/* the number of files for which there is room */
+	size_t capacity;
+};
+
+/*
+ * Create an empty plan.
+ * plan:	the plan to initialize,
+ *		which must later be freed with "destroy_shard_plan"
+ */
+void init_shard_plan(struct shard_plan *plan);
+/*
+ * Free the memory used by a plan.
+ * plan:	the plan to free
+ */
+void destroy_shard_plan(struct shard_plan *plan);
+/*
+ * Add a file to the plan.
+ * plan:		the plan to which to add the file
+ * relative_path:	the path of the file, relative to the searched path
+ * size:		the size of the file in bytes
+ * returns		0 on success,
+ *			-1 on failure, with errno set by "realloc"
+ */
+int add_planned_file(struct shard_plan *plan, const char *relative_path,
+		     uint64_t size);
+/*
+ * Assign the added files to shards,
+ * so that each shard gets about the same number of bytes.
+ * The assignment only depends on the paths and sizes of the files,
+ * not the order in which they were added.
+ * plan:	the plan whose files to assign
+ * n_shards:	the number of shards
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "calloc"
+ */
+int make_shard_plan(struct shard_plan *plan, unsigned n_shards);
+/*
+ * Find the shard assigned to a file by the plan.
+ * plan:		the plan made by "make_shard_plan"
+ * relative_path:	the path of the file, relative to the searched path
+ * n_shards:		the number of shards
+ * returns		the index of the shard, falling back to
+ *			"shard_of_path" for files that were not planned
+ */
+unsigned planned_shard_of_path(const struct shard_plan *plan,
+			       const char *relative_path, unsigned n_shards);
+
+/*
+ * Merge the outputs of the shards of a search,
+ * so that the files are in the same order as if
+ * the whole search had been done at once,
+ * which, since sharded searches sort the entries of each directory,
+ * does not depend on the file systems that the shards searched.
+ * out:		the output stream to which to print the merged output
+ * inputs:	the outputs of the shards
+ * n_inputs:	the number of shards
+ * returns	0 on success,
+ *		-1 on failure, with errno set by
+ *		   "getline" if reading failed,
+ *		   or to EINVAL if an input is not the output of a shard,
+ *		   if its files are out of order,
+ *		   or if several shards searched the same file
+ */
+int merge_shard_outputs(FILE *out, FILE **inputs, size_t n_inputs);
+
+#endif /* SHARD_H */
@@ -0,0 +1,208 @@
+/*
+ * approximate statistics about the strings found in a search,
+ * in a fixed amount of memory regardless of the number of strings
+ */
+#ifndef SKETCH_H
+#define SKETCH_H
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* the smallest and largest numbers of bits choosing a register */
+#define MIN_HYPERLOGLOG_PRECISION	4
+#define MAX_HYPERLOGLOG_PRECISION	18
+
+/*
+ * an estimate of the number of distinct hashes added,
+ * with a relative error of about 1.04 / sqrt(2 ^ "precision")
+ */
+struct hyperloglog {
+	/* the number of bits of each hash that choose its register */
+	unsigned precision;
+	/*
+	 * the most leading zeros, plus 1, seen in the rest of any hash
+	 * choosing each register, of which there are 2 ^ "precision"
+	 */
+	uint8_t *registers;
+};
+
+/*
+ * Create an empty estimate.
+ * hll:		the estimate to initialize,
+ *		which must later be freed with "destroy_hyperloglog"
+ *		if this function succeeds
+ * precision:	the number of bits choosing each register, from
+ *		"MIN_HYPERLOGLOG_PRECISION" to "MAX_HYPERLOGLOG_PRECISION"
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "calloc"
+ */
+int init_hyperloglog(struct hyperloglog *hll, unsigned precision);
+/*
+ * Free the memory used by an estimate.
+ * hll:		the estimate to free
+ */
+void destroy_hyperloglog(struct hyperloglog *hll);
+/*
+ * Forget every hash added to an estimate, so that it can be reused.
+ * hll:		the estimate to empty
+ */
+void clear_hyperloglog(struct hyperloglog *hll);
+/*
+ * Add a hash to an estimate.
+ * hll:		the estimate to which to add the hash
+ * hash:	a well-mixed 64-bit hash
+ */
+void add_hyperloglog(struct hyperloglog *hll, uint64_t hash);
+/*
+ * Add every hash added to one estimate to another.
+ * into:	the estimate to which to add the hashes
+ * from:	the estimate whose hashes to add,
+ *		which must have the same precision
+ */
+void merge_hyperloglog(struct hyperloglog *into,
+		       const struct hyperloglog *from);
+/*
+ * Estimate the number of distinct hashes added.
+ * hll:		the estimate
+ * returns	the estimated number of distinct hashes
+ */
+double estimate_hyperloglog(const struct hyperloglog *hll);
+
+/* the number of bytes of each frequent string that are kept */
+#define MAX_HITTER_BYTES	64
+/*
+ * the most frequent strings that a sketch can print,
+ * so that every saved sketch can be loaded again
+ */
+#define MAX_SKETCH_TOP		((size_t) 1 << 18)
+
+/* a string that might be among the most frequent ones */
+struct heavy_hitter {
+	/* the hash of the string */
+	uint64_t hash;
+	/* the estimated number of appearances */
+	uint64_t count;
+	/* the length of the whole string */
+	size_t length;
+	/* the first bytes of the string, up to "MAX_HITTER_BYTES" */
+	char string[MAX_HITTER_BYTES];
+};
+
+/* approximate statistics about every string added */
+struct string_sketch {
+	/* the number of distinct strings */
+	struct hyperloglog distinct;
+	/* the number of rows in the count-min sketch */
+	unsigned depth;
+	/* the number of counters in each row, which is a power of 2 */
+	size_t width;
+	/*
+	 * the count-min sketch, whose rows each count every string
+	 * in a counter chosen by a different hash,
+	 * so that the smallest counter bounds the string's count
+	 */
+	uint64_t *counters;
+	/*
+	 * the most frequent strings so far, as a heap,
+	 * in which each string is no more frequent than those after it,
+	 * so that the least frequent one is first
+	 */
+	struct heavy_hitter *hitters;
+	/* the number of strings in "hitters" */
+	size_t n_hitters;
+	/*
+	 * the open-addressing table finding strings in "hitters"
+	 * by their hashes, in which each slot holds a position
+	 * in "hitters" plus 1, or 0 if it is empty
+	 */
+	size_t *hitter_slots;
+	/* the number of slots in "hitter_slots", which is a power of 2 */
+	size_t n_hitter_slots;
+	/*
+	 * the number of most frequent strings to keep,
+	 * which is more than are printed, so that strings that are
+	 * just below the top in every merged sketch are not lost
+	 */
+	size_t max_hitters;
+	/* the number of most frequent strings to print */
+	size_t n_top;
+	/* the number of strings added, including repeats */
+	uint64_t n_strings;
+};
+
+/*
+ * Create an empty sketch, using about "memory_size" bytes,
+ * and a few hundred bytes more for each string to print.
+ * Sketches created with the same arguments can be merged.
+ * sketch:	the sketch to initialize,
+ *		which must later be freed with "destroy_string_sketch"
+ *		if this function succeeds
+ * memory_size:	the number of bytes to use, shared between
+ *		the count of distinct strings and the count-min sketch
+ * n_top:	the number of most frequent strings to print,
+ *		at most "MAX_SKETCH_TOP"
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "calloc",
+ *		   or to EINVAL if "n_top" is too large
+ */
+int init_string_sketch(struct string_sketch *sketch, size_t memory_size,
+		       size_t n_top);
+/*
+ * Free the memory used by a sketch.
+ * sketch:	the sketch to free
+ */
+void destroy_string_sketch(struct string_sketch *sketch);
+/*
+ * Add an appearance of a string to a sketch.
+ * sketch:	the sketch to which to add the string
+ * string:	the string, including its quotation marks
+ * length:	the length of the string
+ * hash:	the hash of the string, from "hash_bytes"
+ */
+void add_string_sketch(struct string_sketch *sketch, const char *string,
+		       size_t length, uint64_t hash);
+/*
+ * Add every string added to one sketch to another,
+ * as if they had all been added to the same sketch.
+ * into:	the sketch to which to add the strings
+ * from:	the sketch whose strings to add
+ * returns	0 on success,
+ *		-1 if the sketches were created with different sizes,
+ *		   with errno set to EINVAL
+ */
+int merge_string_sketch(struct string_sketch *into,
+			const struct string_sketch *from);
+/*
+ * Print the number of strings, the estimated number of distinct strings,
+ * and the "n_top" most frequent strings with their estimated counts,
+ * as "~[count]\t[string]", from the most frequent.
+ * Strings that were too long to keep whole end with "[...]".
+ * If there is no memory to sort the strings,
+ * they are printed in no particular order.
+ * out:		the output stream to which to print
+ * sketch:	the sketch to print
+ */
+void print_string_sketch(FILE *out, const struct string_sketch *sketch);
+/*
+ * Save a sketch in its binary format, so that it can be merged later.
+ * sketch:	the sketch to save
+ * out:		the output stream to which to write
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "fwrite"
+ */
+int write_string_sketch(const struct string_sketch *sketch, FILE *out);
+/*
+ * Load a sketch saved by "write_string_sketch".
+ * sketch:	stores the sketch,
+ *		which must later be freed with "destroy_string_sketch"
+ *		if this function succeeds
+ * in:		the input stream from which to read
+ * returns	0 on success,
+ *		-1 on failure, with errno set by
+ *		   "fread" if reading failed,
+ *		   or by "calloc";
+ *		   or to EINVAL if the input is not a sketch
+ */
+int read_string_sketch(struct string_sketch *sketch, FILE *in);
+
+#endif /* SKETCH_H */
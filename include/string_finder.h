@@ -1,8 +1,165 @@
 /* functions for finding and printing strings in a file or directory */
 #ifndef STRING_FINDER_H
 #define STRING_FINDER_H
+#include <scan_kernel_level.h>
+
 #include <stdio.h>
+#include <stddef.h>
+
+/* the ways of deciding whether a file is text that should be searched */
+enum text_encoding {
+	/* Only printable ASCII characters and whitespace are allowed. */
+	ASCII_ENCODING,
+	/* Any valid UTF-8 without non-whitespace control characters. */
+	UTF8_ENCODING
+};
+
+/* the ways of reading a file into memory */
+enum io_method {
+	/* Choose for each file by its size, as measured on this machine. */
+	AUTO_IO,
+	/* Copy the file into a buffer reused for every file, with "read". */
+	READ_IO,
+	/* Map the file into memory with "mmap". */
+	MMAP_IO
+};
+
+/* the settings for a search */
+struct string_finder_options {
+	/*
+	 * Print whole lines containing strings?
+	 * If not, print each string separately.
+	 */
+	int whole_line;
+	/* the encoding that a file must have in order to be searched */
+	enum text_encoding encoding;
+	/*
+	 * Search the targets of symbolic links found in directories?
+	 * Each file or directory is searched once either way.
+	 */
+	int follow_symlinks;
+	/* Skip directories and files on other devices than the root? */
+	int one_file_system;
+	/*
+	 * In whole-line mode, the longest line to print whole.
+	 * Longer lines are cut down to their strings,
+	 * and the bytes around them, or 0 for no limit.
+	 */
+	size_t max_line_bytes;
+	/*
+	 * the number of bytes of a string to print
+	 * before skipping to its end, or 0 for no limit
+	 */
+	size_t max_string_bytes;
+	/*
+	 * If not NULL, the path to which to save the strings in each file,
+	 * instead of printing them
+	 */
+	const char *save_baseline_path;
+	/*
+	 * If not NULL, the path of a baseline saved earlier.
+	 * Only the strings that were added to or removed from each file
+	 * since then are printed, regardless of the lines containing them.
+	 */
+	const char *diff_baseline_path;
+	/*
+	 * the number of shards into which the search is split,
+	 * or 0 to search every file.
+	 * Each file in the output of a shard is preceded by a line
+	 * giving its position in the traversal,
+	 * so that "merge_shard_outputs" can combine the shards.
+	 */
+	unsigned n_shards;
+	/* the index of this shard, from 0 to "n_shards" - 1 */
+	unsigned shard_index;
+	/*
+	 * Assign files to shards so that the shards get similar numbers
+	 * of bytes, after collecting the sizes of all files?
+	 * If not, files are assigned by the hashes of their paths.
+	 */
+	int balance_shards;
+	/*
+	 * If not NULL, the path to which to save an index of the strings
+	 * in every file, instead of printing them,
+	 * for answering substring queries with "query_index" later
+	 */
+	const char *build_index_path;
+	/*
+	 * Instead of printing the strings, only print approximate
+	 * statistics about them: the estimated number of distinct strings
+	 * in each directory and overall, and the most frequent strings,
+	 * using a fixed amount of memory regardless of the number of strings
+	 */
+	int sketch;
+	/* the number of bytes for the statistics about the whole search */
+	size_t sketch_size;
+	/* the number of most frequent strings to print */
+	size_t sketch_top;
+	/*
+	 * If not NULL, the path to which to save the statistics,
+	 * instead of printing them, so that the statistics of several
+	 * shards can be merged with "merge_string_sketch"
+	 */
+	const char *save_sketch_path;
+	/*
+	 * If not NULL, the revision whose files to search,
+	 * read from the object store of the git repository
+	 * at the searched path instead of from the working tree.
+	 * Files are named by their paths in the repository.
+	 */
+	const char *git_rev;
+	/*
+	 * If not NULL while searching a git revision,
+	 * the revision against which to compare it,
+	 * so that only the files added or changed since then are searched
+	 */
+	const char *git_base_rev;
+	/* the way of reading files, or AUTO_IO to choose for each file */
+	enum io_method io_method;
+	/*
+	 * Scan every file with the kernels at "kernel_level",
+	 * rather than choosing for each file by its size?
+	 */
+	int force_kernels;
+	/* the kernels with which to scan every file, if forced */
+	enum scan_kernel_level kernel_level;
+	/*
+	 * the path of the file caching the thresholds that choose
+	 * how each file is read and scanned, which are measured
+	 * and saved if the file is missing or stale,
+	 * or NULL to use the default thresholds without measuring
+	 */
+	const char *engine_config_path;
+};
+
+/* the default number of bytes for the statistics about the strings */
+#define DEFAULT_SKETCH_SIZE	(1 << 20)
+/* the default number of most frequent strings to print */
+#define DEFAULT_SKETCH_TOP	10
 
+/*
+ * Fill in the default settings,
+ * which print strings separately from ASCII files,
+ * following symbolic links across all devices,
+ * without limiting the length of lines or strings,
+ * without a baseline, an index or a sketch,
+ * from the files on disk rather than a git revision,
+ * reading and scanning each file with the default thresholds,
+ * and without splitting the search into shards.
+ * options:	the options to fill in
+ */
+void init_string_finder_options(struct string_finder_options *options);
+/*
+ * Print the strings, or lines containing strings,
+ * in the file or the entire directory, as chosen by the options.
+ * out:		the output stream to which to print
+ * root_path:	the path to the file or root directory to search,
+ *		or to the git repository if searching a revision
+ * options:	the settings for the search
+ * returns	0 on success, -1 otherwise.
+ */
+int find_strings_with_options(FILE *out, const char *root_path,
+			      const struct string_finder_options *options);
 /*
  * Separately print out each instance of strings
  * in the file or the entire directory.
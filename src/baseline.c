@@ -0,0 +1,735 @@
+#include <baseline.h>
+
+#include <binary_number.h>
+#include <byte_hash.h>
+#include <logger.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* the number of entries in a new table, which must be a power of 2 */
+#define INITIAL_CAPACITY	64
+
+int init_string_tally(struct string_tally *tally)
+{
+	tally->entries = calloc(INITIAL_CAPACITY, sizeof(*tally->entries));
+	if (tally->entries == NULL) {
+		return -1;
+	}
+
+	tally->capacity = INITIAL_CAPACITY;
+	tally->size = 0;
+	return 0;
+}
+
+void destroy_string_tally(struct string_tally *tally)
+{
+	free(tally->entries);
+}
+
+void clear_string_tally(struct string_tally *tally)
+{
+	memset(tally->entries, 0, tally->capacity * sizeof(*tally->entries));
+	tally->size = 0;
+}
+
+/*
+ * Find the entry for a string, or the unused entry where it belongs.
+ * Strings with the same hash are compared, so that they are not merged.
+ * entries:	the table of entries
+ * capacity:	the number of entries, which is a power of 2
+ * hash:	the hash of the string
+ * string:	the string
+ * length:	the length of the string
+ * returns	the entry
+ */
+static struct string_tally_entry *find_entry(struct string_tally_entry *entries,
+					     size_t capacity, uint64_t hash,
+					     const char *string, size_t length)
+{
+	size_t mask = capacity - 1;
+	size_t entry_i = hash & mask;
+
+	while (entries[entry_i].count != 0 &&
+	       (entries[entry_i].hash != hash ||
+		entries[entry_i].length != length ||
+		memcmp(entries[entry_i].first, string, length) != 0)) {
+		entry_i = (entry_i + 1) & mask;
+	}
+	return entries + entry_i;
+}
+
+/*
+ * Double the size of the table, and move the entries into the new table.
+ * tally:	the tally to grow
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "calloc",
+ *		   in which case the tally is unchanged
+ */
+static int grow_tally(struct string_tally *tally)
+{
+	size_t new_capacity = tally->capacity * 2;
+	struct string_tally_entry *new_entries = calloc(new_capacity,
+							sizeof(*new_entries));
+	size_t entry_i;
+
+	if (new_entries == NULL) {
+		return -1;
+	}
+
+	for (entry_i = 0; entry_i < tally->capacity; entry_i++) {
+		struct string_tally_entry *entry = tally->entries + entry_i;
+
+		if (entry->count != 0) {
+			*find_entry(new_entries, new_capacity, entry->hash,
+				    entry->first, entry->length) = *entry;
+		}
+	}
+
+	free(tally->entries);
+	tally->entries = new_entries;
+	tally->capacity = new_capacity;
+	return 0;
+}
+
+int tally_string(struct string_tally *tally, const char *string,
+		 size_t length, size_t line_number)
+{
+	uint64_t hash = hash_bytes(string, length);
+	struct string_tally_entry *entry;
+
+	/* Keep the table at most half full, so that probes stay short. */
+	if ((tally->size + 1) * 2 > tally->capacity && grow_tally(tally)) {
+		return -1;
+	}
+
+	entry = find_entry(tally->entries, tally->capacity, hash, string,
+			   length);
+	if (entry->count == 0) {
+		entry->hash = hash;
+		entry->first = string;
+		entry->length = length;
+		entry->line_number = line_number;
+		tally->size++;
+	}
+	entry->count++;
+	return 0;
+}
+
+/*
+ * Find the number of bytes of a string that are kept in a baseline:
+ * the whole string if it is short enough,
+ * or else its first "STORED_STRING_BYTES" - 1 bytes and its last byte.
+ * length:	the length of the string, which must not be 0
+ * returns	the number of bytes kept
+ */
+static size_t stored_length(uint64_t length)
+{
+	return length < STORED_STRING_BYTES ? length : STORED_STRING_BYTES;
+}
+
+/*
+ * Order two strings by hash, then length, then the bytes of them
+ * that are kept in a baseline,
+ * so that strings with the same hash can be told apart.
+ * first_hash:		the hash of the first string
+ * first_length:	the length of the first string
+ * first_head:		the first bytes of the first string
+ * first_last:		the last byte of the first string
+ * second_hash:		the hash of the second string
+ * second_length:	the length of the second string
+ * second_head:		the first bytes of the second string
+ * second_last:		the last byte of the second string
+ * returns		negative if the first string comes first,
+ *			positive if it comes second,
+ *			and 0 if the strings are equal
+ */
+static int compare_strings(uint64_t first_hash, uint64_t first_length,
+			   const char *first_head, char first_last,
+			   uint64_t second_hash, uint64_t second_length,
+			   const char *second_head, char second_last)
+{
+	int order;
+
+	if (first_hash != second_hash) {
+		return first_hash < second_hash ? -1 : 1;
+	}
+	if (first_length != second_length) {
+		return first_length < second_length ? -1 : 1;
+	}
+	order = memcmp(first_head, second_head,
+		       stored_length(first_length) - 1);
+	if (order != 0) {
+		return order;
+	}
+	return (unsigned char) first_last - (unsigned char) second_last;
+}
+
+/*
+ * Order tally entries by hash, then by text, for "qsort".
+ * first:	the first entry to compare
+ * second:	the second entry to compare
+ * returns	negative if the first entry comes first,
+ *		positive if it comes second,
+ *		and 0 if the entries are equal
+ */
+static int compare_tally_entries(const void *first, const void *second)
+{
+	const struct string_tally_entry *first_entry = first;
+	const struct string_tally_entry *second_entry = second;
+
+	return compare_strings(first_entry->hash, first_entry->length,
+			       first_entry->first,
+			       first_entry->first[first_entry->length - 1],
+			       second_entry->hash, second_entry->length,
+			       second_entry->first,
+			       second_entry->first[second_entry->length - 1]);
+}
+
+/*
+ * Order a string now in a file against a string in the baseline,
+ * in the same order as "compare_tally_entries".
+ * entry:	the string now in the file
+ * old:		the string in the baseline
+ * returns	negative if the string in the file comes first,
+ *		positive if it comes second,
+ *		and 0 if the strings are equal
+ */
+static int compare_to_old(const struct string_tally_entry *entry,
+			  const struct string_count *old)
+{
+	return compare_strings(entry->hash, entry->length, entry->first,
+			       entry->first[entry->length - 1],
+			       old->hash, old->length, old->literal,
+			       old->literal[stored_length(old->length) - 1]);
+}
+
+/*
+ * Order tally entries by the position of their first appearance,
+ * for "qsort".
+ * first:	the first entry to compare
+ * second:	the second entry to compare
+ * returns	negative if the first entry comes first,
+ *		positive if it comes second,
+ *		and 0 if the entries are equal
+ */
+static int compare_positions(const void *first, const void *second)
+{
+	const char *first_position =
+		((const struct string_tally_entry *) first)->first;
+	const char *second_position =
+		((const struct string_tally_entry *) second)->first;
+
+	return (first_position > second_position) -
+	       (first_position < second_position);
+}
+
+/*
+ * Move the used entries to the front of the table,
+ * and sort them by hash, then by text.
+ * The table can no longer be searched until it is cleared.
+ * tally:	the tally to sort
+ */
+static void sort_string_tally(struct string_tally *tally)
+{
+	size_t n_used = 0;
+	size_t entry_i;
+
+	for (entry_i = 0; entry_i < tally->capacity; entry_i++) {
+		if (tally->entries[entry_i].count != 0) {
+			tally->entries[n_used++] = tally->entries[entry_i];
+		}
+	}
+	/* Unused entries in the rest of the table still need clearing. */
+	for (entry_i = n_used; entry_i < tally->capacity; entry_i++) {
+		tally->entries[entry_i].count = 0;
+	}
+
+	qsort(tally->entries, n_used, sizeof(*tally->entries),
+	      compare_tally_entries);
+}
+
+/* the number of slots in a new index, which must be a power of 2 */
+#define INITIAL_INDEX_CAPACITY	64
+/* the value of an unused slot in the index */
+#define NO_FILE			((size_t) -1)
+
+/*
+ * Allocate an empty index.
+ * baseline:	the baseline whose index to allocate
+ * capacity:	the number of slots, which must be a power of 2
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "malloc"
+ */
+static int alloc_index(struct baseline *baseline, size_t capacity)
+{
+	size_t slot_i;
+
+	baseline->index = malloc(capacity * sizeof(*baseline->index));
+	if (baseline->index == NULL) {
+		return -1;
+	}
+
+	for (slot_i = 0; slot_i < capacity; slot_i++) {
+		baseline->index[slot_i] = NO_FILE;
+	}
+	baseline->index_capacity = capacity;
+	return 0;
+}
+
+int init_baseline(struct baseline *baseline)
+{
+	baseline->files = NULL;
+	baseline->n_files = 0;
+	baseline->files_capacity = 0;
+	return alloc_index(baseline, INITIAL_INDEX_CAPACITY);
+}
+
+void destroy_baseline(struct baseline *baseline)
+{
+	size_t file_i;
+
+	for (file_i = 0; file_i < baseline->n_files; file_i++) {
+		free(baseline->files[file_i].path);
+		free(baseline->files[file_i].strings);
+		free(baseline->files[file_i].literals);
+	}
+	free(baseline->files);
+	free(baseline->index);
+}
+
+/*
+ * Find the slot in the index for a file,
+ * or the unused slot where it belongs.
+ * baseline:	the baseline to search
+ * path:	the relative path of the file
+ * returns	the slot
+ */
+static size_t *find_index_slot(const struct baseline *baseline,
+			       const char *path)
+{
+	size_t mask = baseline->index_capacity - 1;
+	size_t slot_i = hash_bytes(path, strlen(path)) & mask;
+
+	while (baseline->index[slot_i] != NO_FILE &&
+	       strcmp(baseline->files[baseline->index[slot_i]].path,
+		      path) != 0) {
+		slot_i = (slot_i + 1) & mask;
+	}
+	return baseline->index + slot_i;
+}
+
+/*
+ * Make room for another file,
+ * keeping the index at most half full.
+ * baseline:	the baseline to grow
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "realloc" or "malloc",
+ *		   in which case the baseline is unchanged
+ */
+static int reserve_file(struct baseline *baseline)
+{
+	if (baseline->n_files == baseline->files_capacity) {
+		size_t new_capacity = baseline->files_capacity == 0 ?
+				      INITIAL_CAPACITY :
+				      baseline->files_capacity * 2;
+		struct baseline_file *new_files =
+			realloc(baseline->files,
+				new_capacity * sizeof(*new_files));
+
+		if (new_files == NULL) {
+			return -1;
+		}
+		baseline->files = new_files;
+		baseline->files_capacity = new_capacity;
+	}
+
+	if ((baseline->n_files + 1) * 2 > baseline->index_capacity) {
+		size_t *old_index = baseline->index;
+		size_t old_capacity = baseline->index_capacity;
+		size_t file_i;
+
+		if (alloc_index(baseline, old_capacity * 2)) {
+			baseline->index = old_index;
+			baseline->index_capacity = old_capacity;
+			return -1;
+		}
+		for (file_i = 0; file_i < baseline->n_files; file_i++) {
+			*find_index_slot(baseline,
+					 baseline->files[file_i].path) = file_i;
+		}
+		free(old_index);
+	}
+
+	return 0;
+}
+
+/*
+ * Add a file with its strings already filled in.
+ * The file's memory then belongs to the baseline.
+ * baseline:	the baseline to which to add the file
+ * file:	the file to add
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "reserve_file",
+ *		   in which case the file still belongs to the caller
+ */
+static int insert_file(struct baseline *baseline,
+		       const struct baseline_file *file)
+{
+	if (reserve_file(baseline)) {
+		return -1;
+	}
+
+	*find_index_slot(baseline, file->path) = baseline->n_files;
+	baseline->files[baseline->n_files++] = *file;
+	return 0;
+}
+
+/*
+ * Keep the bytes of a string that are stored in a baseline.
+ * literal:	stores the bytes, of which there are "stored_length(length)"
+ * string:	the string
+ * length:	the length of the string, which must not be 0
+ */
+static void store_literal(char *literal, const char *string, size_t length)
+{
+	size_t n_stored = stored_length(length);
+
+	memcpy(literal, string, n_stored - 1);
+	literal[n_stored - 1] = string[length - 1];
+}
+
+int add_baseline_file(struct baseline *baseline, const char *path,
+		      uint64_t content_hash, struct string_tally *tally)
+{
+	struct baseline_file file;
+	size_t literals_size = 0;
+	size_t string_i;
+
+	sort_string_tally(tally);
+	for (string_i = 0; string_i < tally->size; string_i++) {
+		literals_size += stored_length(tally->entries[string_i].length);
+	}
+
+	file.path = strdup(path);
+	file.content_hash = content_hash;
+	file.n_strings = tally->size;
+	file.strings = malloc((tally->size + 1) * sizeof(*file.strings));
+	file.literals = malloc(literals_size + 1);
+	file.visited = 0;
+	if (file.path == NULL || file.strings == NULL ||
+	    file.literals == NULL) {
+		goto fail;
+	}
+
+	literals_size = 0;
+	for (string_i = 0; string_i < tally->size; string_i++) {
+		const struct string_tally_entry *entry = tally->entries +
+							 string_i;
+		struct string_count *string = file.strings + string_i;
+
+		string->hash = entry->hash;
+		string->count = entry->count;
+		string->length = entry->length;
+		string->literal = file.literals + literals_size;
+		store_literal(file.literals + literals_size, entry->first,
+			      entry->length);
+		literals_size += stored_length(entry->length);
+	}
+
+	if (insert_file(baseline, &file)) {
+		goto fail;
+	}
+	return 0;
+fail:
+	free(file.path);
+	free(file.strings);
+	free(file.literals);
+	return -1;
+}
+
+struct baseline_file *find_baseline_file(const struct baseline *baseline,
+					 const char *path)
+{
+	size_t file_i = *find_index_slot(baseline, path);
+
+	return file_i == NO_FILE ? NULL : baseline->files + file_i;
+}
+
+/* the bytes at the start of every baseline file */
+#define BASELINE_MAGIC		"SFBASE02"
+#define BASELINE_MAGIC_LEN	(sizeof(BASELINE_MAGIC) - 1)
+/* the longest path that will be read from a baseline */
+#define MAX_PATH_LEN		(1 << 16)
+
+int write_baseline(const struct baseline *baseline, FILE *out)
+{
+	size_t file_i;
+
+	if (fwrite(BASELINE_MAGIC, 1, BASELINE_MAGIC_LEN, out) !=
+	    BASELINE_MAGIC_LEN ||
+	    write_number(out, baseline->n_files, sizeof(uint64_t))) {
+		return -1;
+	}
+
+	for (file_i = 0; file_i < baseline->n_files; file_i++) {
+		const struct baseline_file *file = baseline->files + file_i;
+		size_t path_len = strlen(file->path);
+		uint64_t literals_size = 0;
+		size_t string_i;
+
+		for (string_i = 0; string_i < file->n_strings; string_i++) {
+			literals_size +=
+				stored_length(file->strings[string_i].length);
+		}
+
+		if (write_number(out, path_len, sizeof(uint32_t)) ||
+		    fwrite(file->path, 1, path_len, out) != path_len ||
+		    write_number(out, file->content_hash, sizeof(uint64_t)) ||
+		    write_number(out, file->n_strings, sizeof(uint64_t)) ||
+		    write_number(out, literals_size, sizeof(uint64_t))) {
+			return -1;
+		}
+
+		for (string_i = 0; string_i < file->n_strings; string_i++) {
+			const struct string_count *string = file->strings +
+							    string_i;
+			size_t n_stored = stored_length(string->length);
+
+			if (write_number(out, string->hash,
+					 sizeof(uint64_t)) ||
+			    write_number(out, string->count,
+					 sizeof(uint64_t)) ||
+			    write_number(out, string->length,
+					 sizeof(uint64_t)) ||
+			    fwrite(string->literal, 1, n_stored, out) !=
+			    n_stored) {
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Read the next file in a baseline.
+ * in:		the input stream from which to read
+ * file:	stores the file, whose memory then belongs to the caller
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "fread" or "malloc",
+ *		   or to EINVAL if the input is not a baseline
+ */
+static int read_baseline_file(FILE *in, struct baseline_file *file)
+{
+	uint64_t path_len, n_strings, literals_size;
+	size_t literals_used = 0;
+	size_t string_i;
+
+	file->path = NULL;
+	file->strings = NULL;
+	file->literals = NULL;
+	file->visited = 0;
+
+	if (read_number(in, &path_len, sizeof(uint32_t))) {
+		return -1;
+	}
+	if (path_len > MAX_PATH_LEN) {
+		errno = EINVAL;
+		return -1;
+	}
+	if ((file->path = malloc(path_len + 1)) == NULL) {
+		return -1;
+	}
+	if (fread(file->path, 1, path_len, in) != path_len ||
+	    memchr(file->path, '\0', path_len) != NULL) {
+		goto fail;
+	}
+	file->path[path_len] = '\0';
+
+	if (read_number(in, &file->content_hash, sizeof(uint64_t)) ||
+	    read_number(in, &n_strings, sizeof(uint64_t)) ||
+	    read_number(in, &literals_size, sizeof(uint64_t))) {
+		goto fail;
+	}
+	/* Check the sizes before trusting them with an allocation. */
+	if (n_strings > SIZE_MAX / sizeof(*file->strings) - 1 ||
+	    literals_size / STORED_STRING_BYTES > n_strings ||
+	    literals_size > SIZE_MAX - 1) {
+		errno = EINVAL;
+		goto fail;
+	}
+	file->n_strings = n_strings;
+	file->strings = malloc((n_strings + 1) * sizeof(*file->strings));
+	file->literals = malloc(literals_size + 1);
+	if (file->strings == NULL || file->literals == NULL) {
+		goto fail;
+	}
+
+	for (string_i = 0; string_i < n_strings; string_i++) {
+		struct string_count *string = file->strings + string_i;
+		size_t n_stored;
+
+		if (read_number(in, &string->hash, sizeof(uint64_t)) ||
+		    read_number(in, &string->count, sizeof(uint64_t)) ||
+		    read_number(in, &string->length, sizeof(uint64_t))) {
+			goto fail;
+		}
+		/* Every string has at least its opening quotation mark. */
+		n_stored = string->length == 0 ? 0 :
+			   stored_length(string->length);
+		if (n_stored == 0 ||
+		    n_stored > literals_size - literals_used) {
+			errno = EINVAL;
+			goto fail;
+		}
+		string->literal = file->literals + literals_used;
+		if (fread(file->literals + literals_used, 1, n_stored, in) !=
+		    n_stored) {
+			goto fail;
+		}
+		literals_used += n_stored;
+	}
+	if (literals_used != literals_size) {
+		errno = EINVAL;
+		goto fail;
+	}
+	return 0;
+fail:
+	free(file->path);
+	free(file->strings);
+	free(file->literals);
+	return -1;
+}
+
+int read_baseline(struct baseline *baseline, FILE *in)
+{
+	char magic[BASELINE_MAGIC_LEN];
+	uint64_t n_files, file_i;
+
+	if (fread(magic, 1, BASELINE_MAGIC_LEN, in) != BASELINE_MAGIC_LEN ||
+	    memcmp(magic, BASELINE_MAGIC, BASELINE_MAGIC_LEN) != 0 ||
+	    read_number(in, &n_files, sizeof(uint64_t))) {
+		printlg(ERROR_LEVEL, "Input is not a baseline.\n");
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (file_i = 0; file_i < n_files; file_i++) {
+		struct baseline_file file;
+
+		if (read_baseline_file(in, &file)) {
+			printlg(ERROR_LEVEL,
+				"Failed to read file %u of baseline.\n",
+				(unsigned) file_i);
+			return -1;
+		}
+		if (insert_file(baseline, &file)) {
+			free(file.path);
+			free(file.strings);
+			free(file.literals);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Print a string that was removed,
+ * eliding the bytes of a long string that were not kept.
+ * out:		the output stream to which to print
+ * path:	the relative path of the file that contained the string
+ * string:	the string in the baseline
+ * n_removed:	the number of appearances that were removed
+ */
+static void print_removed(FILE *out, const char *path,
+			  const struct string_count *string,
+			  uint64_t n_removed)
+{
+	size_t n_stored = stored_length(string->length);
+
+	fprintf(out, "%s:\t-%llu\t", path, (unsigned long long) n_removed);
+	fwrite(string->literal, 1, n_stored - 1, out);
+	if (string->length > n_stored) {
+		fprintf(out, "[...]");
+	}
+	fprintf(out, "%c\n", string->literal[n_stored - 1]);
+}
+
+void print_string_changes(FILE *out, const char *path,
+			  const struct baseline_file *old_file,
+			  struct string_tally *tally)
+{
+	size_t n_old = old_file == NULL ? 0 : old_file->n_strings;
+	size_t old_i = 0;
+	size_t n_added = 0;
+	size_t entry_i;
+
+	sort_string_tally(tally);
+
+	/* Merge the sorted lists, printing removals immediately. */
+	for (entry_i = 0; entry_i < tally->size; entry_i++) {
+		struct string_tally_entry *entry = tally->entries + entry_i;
+		uint64_t old_count = 0;
+		int order = 1;
+
+		while (old_i < n_old &&
+		       (order = compare_to_old(entry,
+					       old_file->strings + old_i)) > 0) {
+			print_removed(out, path, old_file->strings + old_i,
+				      old_file->strings[old_i].count);
+			old_i++;
+		}
+		if (old_i < n_old && order == 0) {
+			old_count = old_file->strings[old_i].count;
+			old_i++;
+		}
+
+		if (entry->count > old_count) {
+			/* Keep additions at the front, to print in order. */
+			entry->count -= old_count;
+			tally->entries[n_added++] = *entry;
+		} else if (entry->count < old_count) {
+			print_removed(out, path, old_file->strings + old_i - 1,
+				      old_count - entry->count);
+		}
+	}
+	for (; old_i < n_old; old_i++) {
+		print_removed(out, path, old_file->strings + old_i,
+			      old_file->strings[old_i].count);
+	}
+
+	qsort(tally->entries, n_added, sizeof(*tally->entries),
+	      compare_positions);
+	for (entry_i = 0; entry_i < n_added; entry_i++) {
+		const struct string_tally_entry *entry = tally->entries +
+							 entry_i;
+
+		fprintf(out, "%s (%u):\t+%llu\t", path,
+			(unsigned) entry->line_number,
+			(unsigned long long) entry->count);
+		fwrite(entry->first, 1, entry->length, out);
+		fprintf(out, "\n");
+	}
+}
+
+void print_removed_files(FILE *out, const struct baseline *baseline)
+{
+	size_t file_i;
+
+	for (file_i = 0; file_i < baseline->n_files; file_i++) {
+		const struct baseline_file *file = baseline->files + file_i;
+		size_t string_i;
+
+		if (file->visited) {
+			continue;
+		}
+		for (string_i = 0; string_i < file->n_strings; string_i++) {
+			print_removed(out, file->path,
+				      file->strings + string_i,
+				      file->strings[string_i].count);
+		}
+	}
+}
@@ -0,0 +1,28 @@
+#include <binary_number.h>
+
+int write_number(FILE *out, uint64_t value, size_t n_bytes)
+{
+	unsigned char bytes[sizeof(value)];
+	size_t byte_i;
+
+	for (byte_i = 0; byte_i < n_bytes; byte_i++) {
+		bytes[byte_i] = value >> (8 * byte_i);
+	}
+	return fwrite(bytes, 1, n_bytes, out) == n_bytes ? 0 : -1;
+}
+
+int read_number(FILE *in, uint64_t *value, size_t n_bytes)
+{
+	unsigned char bytes[sizeof(*value)];
+	size_t byte_i;
+
+	if (fread(bytes, 1, n_bytes, in) != n_bytes) {
+		return -1;
+	}
+
+	*value = 0;
+	for (byte_i = 0; byte_i < n_bytes; byte_i++) {
+		*value |= (uint64_t) bytes[byte_i] << (8 * byte_i);
+	}
+	return 0;
+}
@@ -0,0 +1,63 @@
+#include <byte_hash.h>
+
+#include <string.h>
+
+/* odd constants with well-mixed bits, from "splitmix64" and "xxhash" */
+#define HASH_SEED		0x9e3779b97f4a7c15ULL
+#define HASH_MULTIPLIER		0xbf58476d1ce4e5b9ULL
+#define HASH_FINAL_MULTIPLIER	0x94d049bb133111ebULL
+/* the number of bytes in each word that is mixed in */
+#define WORD_SIZE		sizeof(uint64_t)
+
+/*
+ * Load 8 bytes as a little-endian word,
+ * so that the hash does not depend on the byte order of the host.
+ * bytes:	the bytes to load, which do not need to be aligned
+ * returns	the word
+ */
+static uint64_t load_word(const unsigned char *bytes)
+{
+	uint64_t word;
+
+	memcpy(&word, bytes, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	word = __builtin_bswap64(word);
+#endif
+	return word;
+}
+
+/*
+ * Mix a word into the hash.
+ * hash:	the hash so far
+ * word:	the word to mix in
+ * returns	the new hash
+ */
+static uint64_t mix_word(uint64_t hash, uint64_t word)
+{
+	hash ^= word * HASH_MULTIPLIER;
+	hash = (hash << 31) | (hash >> 33);
+	return hash * HASH_FINAL_MULTIPLIER;
+}
+
+uint64_t hash_bytes(const void *bytes, size_t length)
+{
+	const unsigned char *cursor = bytes;
+	uint64_t hash = HASH_SEED ^ (length * HASH_MULTIPLIER);
+	unsigned char tail[WORD_SIZE];
+	size_t remaining;
+
+	for (remaining = length; remaining >= WORD_SIZE;
+	     remaining -= WORD_SIZE) {
+		hash = mix_word(hash, load_word(cursor));
+		cursor += WORD_SIZE;
+	}
+
+	/* Pad the last partial word with zeros; the length is mixed in. */
+	memset(tail, 0, sizeof(tail));
+	memcpy(tail, cursor, remaining);
+	hash = mix_word(hash, load_word(tail));
+
+	hash ^= hash >> 32;
+	hash *= HASH_MULTIPLIER;
+	return hash ^ (hash >> 29);
+}
@@ -0,0 +1,622 @@
+#define _GNU_SOURCE
+#include <engine.h>
+
+#include <logger.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* the names of the kernel levels */
+static const char *const kernel_level_names[N_KERNEL_LEVELS] = {
+	"scalar", "sse2", "avx2"
+};
+
+const char *kernel_level_name(enum scan_kernel_level level)
+{
+	return kernel_level_names[level];
+}
+
+int parse_kernel_level(const char *name, enum scan_kernel_level *level)
+{
+	int level_i;
+
+	for (level_i = 0; level_i < N_KERNEL_LEVELS; level_i++) {
+		if (strcmp(name, kernel_level_names[level_i]) == 0) {
+			*level = level_i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+void default_engine_thresholds(struct engine_thresholds *thresholds)
+{
+	thresholds->min_mmap_size = UINT64_MAX;
+	thresholds->min_vector_size = 0;
+	thresholds->vector_level = best_scan_kernel_level();
+}
+
+/* the number of times each measurement is taken, keeping the fastest */
+#define N_ROUNDS		3
+/* the number of bytes scanned in each measurement of the kernels */
+#define KERNEL_BYTES		(1 << 20)
+/* the number of bytes read in each measurement of reading a file */
+#define READ_BYTES		(1 << 22)
+/* the sizes of text on which the kernels are measured */
+static const size_t kernel_sizes[] = {
+	16, 64, 256, 1 << 10, 1 << 12, 1 << 14, 1 << 16
+};
+#define N_KERNEL_SIZES	(sizeof(kernel_sizes) / sizeof(*kernel_sizes))
+/* the sizes of file on which reading is measured */
+static const size_t read_sizes[] = {
+	1 << 14, 1 << 16, 1 << 18, 1 << 20, READ_BYTES
+};
+#define N_READ_SIZES	(sizeof(read_sizes) / sizeof(*read_sizes))
+/* the lines repeated to make the sample text, like typical code */
+static const char sample_lines[] =
+	"\tif (error) {\n"
+	"\t\tprintlg(ERROR_LEVEL, \"Failed to open %s.\\n\", path);\n"
+	"\t\treturn -1;\n"
+	"\t}\n"
+	"\t/* Count the separators, like '/', in the path. */\n";
+
+/* the results of the kernels, kept so that they are not optimized out */
+static volatile size_t sample_sink;
+
+/*
+ * Get the current time, for measuring.
+ * returns	the time in seconds, from an arbitrary start
+ */
+static double now(void)
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/*
+ * Scan text as a search does: check that it is text,
+ * then find every quotation mark, counting the lines before each.
+ * kernels:	the kernels with which to scan
+ * start:	the beginning of the text
+ * end:		the end of the text
+ * returns	the number of quotation marks and lines found
+ */
+static size_t scan_sample(const struct scan_kernels *kernels,
+			  const char *start, const char *end)
+{
+	const char *cursor = start;
+	const char *counted = start;
+	size_t found = 0;
+
+	if (!kernels->is_ascii_text(start, end)) {
+		return 0;
+	}
+	while ((cursor = kernels->find_either_byte(cursor, end, '"',
+						   '\'')) < end) {
+		found += kernels->count_byte(counted, cursor, '\n') + 1;
+		counted = cursor++;
+	}
+	return found;
+}
+
+/*
+ * Measure the time taken by a set of kernels to scan text of a size.
+ * kernels:	the kernels to measure
+ * sample:	the text, of at least "size" bytes
+ * size:	the number of bytes to scan at a time
+ * returns	the fastest time, in seconds,
+ *		to scan "KERNEL_BYTES" bytes "size" bytes at a time
+ */
+static double time_kernels(const struct scan_kernels *kernels,
+			   const char *sample, size_t size)
+{
+	size_t n_repeats = KERNEL_BYTES / size;
+	double best = 0;
+	int round;
+
+	for (round = 0; round < N_ROUNDS; round++) {
+		double start = now();
+		double elapsed;
+		size_t repeat;
+
+		for (repeat = 0; repeat < n_repeats; repeat++) {
+			sample_sink += scan_sample(kernels, sample,
+						   sample + size);
+		}
+		elapsed = now() - start;
+		if (round == 0 || elapsed < best) {
+			best = elapsed;
+		}
+	}
+	return best;
+}
+
+/*
+ * Copy the start of a file into a buffer with "read",
+ * as a search does.
+ * in:		the file descriptor from which to read
+ * buffer:	stores the bytes read
+ * size:	the number of bytes to read
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "pread",
+ *		   or to EIO if the file is too short
+ */
+static int read_sample(int in, char *buffer, size_t size)
+{
+	size_t n_read = 0;
+
+	while (n_read < size) {
+		ssize_t n = pread(in, buffer + n_read, size - n_read, n_read);
+
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			if (n == 0) {
+				errno = EIO;
+			}
+			return -1;
+		}
+		n_read += n;
+	}
+	return 0;
+}
+
+/*
+ * Measure the time taken to read, then check, a file of a size,
+ * either with "read" or with "mmap".
+ * in:		the file descriptor from which to read
+ * buffer:	the buffer for "read", of at least "size" bytes
+ * size:	the number of bytes to read at a time
+ * map:		Map the file, rather than reading it?
+ * time:	stores the fastest time, in seconds,
+ *		to read "READ_BYTES" bytes "size" bytes at a time
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "read_sample" or "mmap"
+ */
+static int time_read(int in, char *buffer, size_t size, int map,
+		     double *time)
+{
+	const struct scan_kernels *kernels =
+		get_scan_kernels(best_scan_kernel_level());
+	size_t n_repeats = READ_BYTES / size;
+	int round;
+
+	for (round = 0; round < N_ROUNDS; round++) {
+		double start = now();
+		double elapsed;
+		size_t repeat;
+
+		for (repeat = 0; repeat < n_repeats; repeat++) {
+			const char *data = buffer;
+
+			if (map) {
+				data = mmap(NULL, size, PROT_READ, MAP_PRIVATE,
+					    in, 0);
+				if (data == MAP_FAILED) {
+					return -1;
+				}
+			} else if (read_sample(in, buffer, size)) {
+				return -1;
+			}
+
+			sample_sink += kernels->is_ascii_text(data,
+							      data + size);
+			if (map) {
+				munmap((void *) data, size);
+			}
+		}
+		elapsed = now() - start;
+		if (round == 0 || elapsed < *time) {
+			*time = elapsed;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Find the smallest size from which a faster way is always at least
+ * as fast as the slower one, among the measured sizes.
+ * sizes:	the measured sizes, in increasing order
+ * n_sizes:	the number of sizes
+ * slow_times:	the time taken at each size the slower way
+ * fast_times:	the time taken at each size the faster way
+ * returns	the smallest size at which the faster way is chosen,
+ *		0 if it wins at every size,
+ *		or UINT64_MAX if it loses at the largest size
+ */
+static uint64_t find_threshold(const size_t *sizes, size_t n_sizes,
+			       const double *slow_times,
+			       const double *fast_times)
+{
+	uint64_t threshold = UINT64_MAX;
+	size_t size_i = n_sizes;
+
+	while (size_i > 0 &&
+	       fast_times[size_i - 1] <= slow_times[size_i - 1]) {
+		threshold = sizes[--size_i];
+	}
+	return size_i == 0 ? 0 : threshold;
+}
+
+/*
+ * Measure which kernels to use for text of each size.
+ * thresholds:	stores the kernels and the size from which they are used
+ * sample:	the text, of at least the largest size
+ */
+static void calibrate_kernels(struct engine_thresholds *thresholds,
+			      const char *sample)
+{
+	const struct scan_kernels *scalar = get_scan_kernels(SCALAR_KERNELS);
+	const struct scan_kernels *vector;
+	double scalar_times[N_KERNEL_SIZES];
+	double vector_times[N_KERNEL_SIZES];
+	double best_time = 0;
+	enum scan_kernel_level level;
+	size_t size_i;
+
+	/* The widest kernels are not always the fastest. */
+	thresholds->vector_level = SCALAR_KERNELS;
+	for (level = SCALAR_KERNELS + 1; level < N_KERNEL_LEVELS; level++) {
+		const struct scan_kernels *kernels = get_scan_kernels(level);
+		double time;
+
+		if (kernels == NULL) {
+			continue;
+		}
+		time = time_kernels(kernels, sample,
+				    kernel_sizes[N_KERNEL_SIZES - 1]);
+		if (thresholds->vector_level == SCALAR_KERNELS ||
+		    time < best_time) {
+			thresholds->vector_level = level;
+			best_time = time;
+		}
+	}
+	if (thresholds->vector_level == SCALAR_KERNELS) {
+		thresholds->min_vector_size = 0;
+		return;
+	}
+
+	vector = get_scan_kernels(thresholds->vector_level);
+	for (size_i = 0; size_i < N_KERNEL_SIZES; size_i++) {
+		scalar_times[size_i] = time_kernels(scalar, sample,
+						    kernel_sizes[size_i]);
+		vector_times[size_i] = time_kernels(vector, sample,
+						    kernel_sizes[size_i]);
+	}
+	thresholds->min_vector_size = find_threshold(kernel_sizes,
+						     N_KERNEL_SIZES,
+						     scalar_times,
+						     vector_times);
+}
+
+/*
+ * Measure the size of file from which mapping it is faster than reading.
+ * thresholds:	stores the size
+ * sample:	the text to write to the file, of the largest size
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "tmpfile", "write",
+ *		   "malloc", "read_sample" or "mmap"
+ */
+static int calibrate_read(struct engine_thresholds *thresholds,
+			  const char *sample)
+{
+	double read_times[N_READ_SIZES];
+	double map_times[N_READ_SIZES];
+	FILE *file = tmpfile();
+	char *buffer;
+	size_t size_i;
+	int error = 0;
+
+	if (file == NULL) {
+		return -1;
+	}
+	if (fwrite(sample, 1, READ_BYTES, file) != READ_BYTES ||
+	    fflush(file) || (buffer = malloc(READ_BYTES)) == NULL) {
+		fclose(file);
+		return -1;
+	}
+
+	for (size_i = 0; !error && size_i < N_READ_SIZES; size_i++) {
+		error = time_read(fileno(file), buffer, read_sizes[size_i], 0,
+				  read_times + size_i) ||
+			time_read(fileno(file), buffer, read_sizes[size_i], 1,
+				  map_times + size_i);
+	}
+	if (!error) {
+		thresholds->min_mmap_size = find_threshold(read_sizes,
+							   N_READ_SIZES,
+							   read_times,
+							   map_times);
+	}
+
+	free(buffer);
+	fclose(file);
+	return error ? -1 : 0;
+}
+
+int calibrate_engine(struct engine_thresholds *thresholds)
+{
+	size_t line_length = sizeof(sample_lines) - 1;
+	char *sample = malloc(READ_BYTES);
+	size_t filled;
+	int error;
+
+	if (sample == NULL) {
+		return -1;
+	}
+	for (filled = 0; filled < READ_BYTES; filled += line_length) {
+		memcpy(sample + filled, sample_lines,
+		       READ_BYTES - filled < line_length ?
+		       READ_BYTES - filled : line_length);
+	}
+
+	calibrate_kernels(thresholds, sample);
+	error = calibrate_read(thresholds, sample);
+	free(sample);
+	return error;
+}
+
+/* the names of the settings in the configuration */
+#define KERNELS_KEY		"kernels"
+#define MIN_MMAP_SIZE_KEY	"min_mmap_size"
+#define MIN_VECTOR_SIZE_KEY	"min_vector_size"
+#define VECTOR_LEVEL_KEY	"vector_level"
+/* the character starting a comment line in the configuration */
+#define COMMENT_MARKER		'#'
+
+int write_engine_config(const struct engine_thresholds *thresholds,
+			FILE *out)
+{
+	if (fprintf(out,
+		    "%c thresholds measured by \"string_finder\"; "
+		    "delete this file to measure them again\n"
+		    "%s %s\n%s %llu\n%s %llu\n%s %s\n",
+		    COMMENT_MARKER,
+		    KERNELS_KEY, kernel_level_name(best_scan_kernel_level()),
+		    MIN_MMAP_SIZE_KEY,
+		    (unsigned long long) thresholds->min_mmap_size,
+		    MIN_VECTOR_SIZE_KEY,
+		    (unsigned long long) thresholds->min_vector_size,
+		    VECTOR_LEVEL_KEY,
+		    kernel_level_name(thresholds->vector_level)) < 0) {
+		return -1;
+	}
+	return 0;
+}
+
+/* the longest line in a valid configuration */
+#define MAX_CONFIG_LINE	128
+/* the settings that must all be in the configuration */
+#define KERNELS_FOUND		(1 << 0)
+#define MIN_MMAP_SIZE_FOUND	(1 << 1)
+#define MIN_VECTOR_SIZE_FOUND	(1 << 2)
+#define VECTOR_LEVEL_FOUND	(1 << 3)
+#define ALL_FOUND		((1 << 4) - 1)
+
+/*
+ * Parse a size in the configuration.
+ * text:	the size, in decimal
+ * size:	stores the size
+ * returns	0 on success, -1 if the text is not a size
+ */
+static int parse_config_size(const char *text, uint64_t *size)
+{
+	char *text_end;
+
+	errno = 0;
+	*size = strtoull(text, &text_end, 10);
+	return errno != 0 || text_end == text || *text_end != '\0' ||
+	       *text == '-' ? -1 : 0;
+}
+
+int read_engine_config(struct engine_thresholds *thresholds, FILE *in)
+{
+	/* Only the thresholds of a valid configuration are stored. */
+	struct engine_thresholds parsed;
+	char line[MAX_CONFIG_LINE];
+	unsigned found = 0;
+
+	while (fgets(line, sizeof(line), in) != NULL) {
+		char *value;
+		enum scan_kernel_level level;
+		int invalid = 0;
+
+		line[strcspn(line, "\n")] = '\0';
+		if (line[0] == COMMENT_MARKER || line[0] == '\0') {
+			continue;
+		}
+		value = strchr(line, ' ');
+		if (value == NULL) {
+			errno = EINVAL;
+			return -1;
+		}
+		*value++ = '\0';
+
+		if (strcmp(line, KERNELS_KEY) == 0) {
+			/* Measurements from another machine do not apply. */
+			invalid = parse_kernel_level(value, &level) ||
+				  level != best_scan_kernel_level();
+			found |= KERNELS_FOUND;
+		} else if (strcmp(line, MIN_MMAP_SIZE_KEY) == 0) {
+			invalid = parse_config_size(value,
+						    &parsed.min_mmap_size);
+			found |= MIN_MMAP_SIZE_FOUND;
+		} else if (strcmp(line, MIN_VECTOR_SIZE_KEY) == 0) {
+			invalid = parse_config_size(value,
+						    &parsed.min_vector_size);
+			found |= MIN_VECTOR_SIZE_FOUND;
+		} else if (strcmp(line, VECTOR_LEVEL_KEY) == 0) {
+			invalid = parse_kernel_level(value, &level) ||
+				  get_scan_kernels(level) == NULL;
+			if (!invalid) {
+				parsed.vector_level = level;
+			}
+			found |= VECTOR_LEVEL_FOUND;
+		} else {
+			invalid = 1;
+		}
+		if (invalid) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+	if (ferror(in)) {
+		return -1;
+	}
+	if (found != ALL_FOUND) {
+		errno = EINVAL;
+		return -1;
+	}
+	*thresholds = parsed;
+	return 0;
+}
+
+/*
+ * the suffix of the temporary file to which the configuration is written,
+ * as a template for "mkstemp"
+ */
+#define TEMP_CONFIG_SUFFIX	".XXXXXX"
+/* the character separating the directories in a path */
+#define PATH_SEPARATOR		'/'
+
+/*
+ * Create the missing directories containing a file, like "mkdir -p".
+ * Failing is left to creating the file itself.
+ * path:	the path of the file
+ */
+static void make_parent_dirs(const char *path)
+{
+	size_t path_len = strlen(path);
+	char parent[path_len + 1];
+	char *separator;
+
+	memcpy(parent, path, path_len + 1);
+	for (separator = strchr(parent + 1, PATH_SEPARATOR);
+	     separator != NULL;
+	     separator = strchr(separator + 1, PATH_SEPARATOR)) {
+		*separator = '\0';
+		mkdir(parent, S_IRWXU);
+		*separator = PATH_SEPARATOR;
+	}
+}
+
+/*
+ * Create the temporary file to which to save thresholds,
+ * in the same directory as the file caching them,
+ * creating the directory if it is missing.
+ * config_path:	the path of the file caching the thresholds
+ * temp_path:	stores the path of the temporary file,
+ *		with room for "sizeof(TEMP_CONFIG_SUFFIX)" bytes
+ *		more than "config_path"
+ * returns	the temporary file, open for writing,
+ *		or NULL on failure, with errno set by "mkstemp" or "fdopen"
+ */
+static FILE *create_temp_config(const char *config_path, char *temp_path)
+{
+	size_t path_len = strlen(config_path);
+	FILE *config;
+	int temp_fd, error;
+
+	memcpy(temp_path, config_path, path_len);
+	memcpy(temp_path + path_len, TEMP_CONFIG_SUFFIX,
+	       sizeof(TEMP_CONFIG_SUFFIX));
+	make_parent_dirs(temp_path);
+	if ((temp_fd = mkstemp(temp_path)) < 0) {
+		return NULL;
+	}
+	if ((config = fdopen(temp_fd, "w")) == NULL) {
+		error = errno;
+		close(temp_fd);
+		unlink(temp_path);
+		errno = error;
+	}
+	return config;
+}
+
+/*
+ * Save thresholds to the temporary file made by "create_temp_config",
+ * then replace the file caching them all at once,
+ * by renaming the temporary file over it,
+ * so that searches calibrating at the same time,
+ * like the shards of a search, never read a partly-written file.
+ * The temporary file is closed, and removed on failure.
+ * thresholds:	the thresholds to save
+ * config:	the temporary file
+ * temp_path:	the path of the temporary file
+ * config_path:	the path of the file caching the thresholds
+ * returns	0 on success,
+ *		-1 on failure, with errno set by
+ *		   "write_engine_config", "fclose" or "rename"
+ */
+static int save_engine_config(const struct engine_thresholds *thresholds,
+			      FILE *config, const char *temp_path,
+			      const char *config_path)
+{
+	int error = write_engine_config(thresholds, config);
+
+	if (fclose(config)) {
+		error = -1;
+	}
+	if (!error && rename(temp_path, config_path)) {
+		error = -1;
+	}
+
+	if (error) {
+		int saved_errno = errno;
+
+		unlink(temp_path);
+		errno = saved_errno;
+	}
+	return error;
+}
+
+void load_engine_thresholds(struct engine_thresholds *thresholds,
+			    const char *config_path, int measure)
+{
+	char temp_path[strlen(config_path) + sizeof(TEMP_CONFIG_SUFFIX)];
+	FILE *config = fopen(config_path, "r");
+	int error;
+
+	if (config != NULL) {
+		error = read_engine_config(thresholds, config);
+		fclose(config);
+		if (!error) {
+			return;
+		}
+	}
+
+	/*
+	 * Thresholds that cannot be cached, as when the home directory
+	 * is read-only, would be measured again by every search,
+	 * costing more than they save, so the defaults are used instead.
+	 */
+	default_engine_thresholds(thresholds);
+	if (!measure ||
+	    (config = create_temp_config(config_path, temp_path)) == NULL) {
+		return;
+	}
+
+	if (calibrate_engine(thresholds)) {
+		printlg(WARNING_LEVEL,
+			"Failed to measure engine thresholds; "
+			"using the defaults.\n");
+		default_engine_thresholds(thresholds);
+		fclose(config);
+		unlink(temp_path);
+		return;
+	}
+
+	if (save_engine_config(thresholds, config, temp_path, config_path)) {
+		printlg(WARNING_LEVEL,
+			"Failed to save engine thresholds to %s.\n",
+			config_path);
+	}
+}
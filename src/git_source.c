@@ -0,0 +1,382 @@
+#define _GNU_SOURCE
+#include <git_source.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/* the file run for every git command, found on the search path */
+#define GIT_COMMAND	"git"
+
+/*
+ * Run a git command, with its output, and optionally its input,
+ * connected to the caller by pipes.
+ * If there is no pipe for its input, it reads from "/dev/null".
+ * argv:	the arguments of the command, ending with NULL
+ * pid:		stores the process ID of the command
+ * to_git:	stores the stream writing to the command's input,
+ *		or NULL for no pipe
+ * from_git:	stores the stream reading from the command's output
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "pipe2",
+ *		   "posix_spawnp" or "fdopen"
+ */
+static int spawn_git(const char *const argv[], pid_t *pid,
+		     FILE **to_git, FILE **from_git)
+{
+	posix_spawn_file_actions_t actions;
+	int out_pipe[2];
+	int in_pipe[2] = {-1, -1};
+	int spawned = 0;
+	int error;
+
+	/* Only the ends duplicated onto the standard streams are inherited. */
+	if (pipe2(out_pipe, O_CLOEXEC)) {
+		return -1;
+	}
+	if (to_git != NULL && pipe2(in_pipe, O_CLOEXEC)) {
+		error = errno;
+		close(out_pipe[0]);
+		close(out_pipe[1]);
+		errno = error;
+		return -1;
+	}
+
+	error = posix_spawn_file_actions_init(&actions);
+	if (!error) {
+		error = posix_spawn_file_actions_adddup2(&actions, out_pipe[1],
+							 STDOUT_FILENO);
+		if (!error && to_git != NULL) {
+			error = posix_spawn_file_actions_adddup2(&actions,
+								 in_pipe[0],
+								 STDIN_FILENO);
+		} else if (!error) {
+			error = posix_spawn_file_actions_addopen(&actions,
+								 STDIN_FILENO,
+								 "/dev/null",
+								 O_RDONLY, 0);
+		}
+		if (!error) {
+			error = posix_spawnp(pid, GIT_COMMAND, &actions, NULL,
+					     (char *const *) argv, environ);
+			spawned = !error;
+		}
+		posix_spawn_file_actions_destroy(&actions);
+	}
+
+	close(out_pipe[1]);
+	if (to_git != NULL) {
+		close(in_pipe[0]);
+	}
+
+	if (!error) {
+		if ((*from_git = fdopen(out_pipe[0], "r")) == NULL) {
+			error = errno;
+		} else {
+			out_pipe[0] = -1;
+		}
+	}
+	if (!error && to_git != NULL) {
+		if ((*to_git = fdopen(in_pipe[1], "w")) == NULL) {
+			error = errno;
+			fclose(*from_git);
+		} else {
+			in_pipe[1] = -1;
+		}
+	}
+	if (!error) {
+		return 0;
+	}
+
+	/* Without its pipes, git stops as soon as it reads or writes. */
+	if (out_pipe[0] >= 0) {
+		close(out_pipe[0]);
+	}
+	if (in_pipe[1] >= 0) {
+		close(in_pipe[1]);
+	}
+	if (spawned) {
+		waitpid(*pid, NULL, 0);
+	}
+	errno = error;
+	return -1;
+}
+
+/*
+ * Wait for a git command to finish.
+ * pid:		the process ID of the command
+ * returns	0 if the command succeeded,
+ *		-1 otherwise, with errno set by "waitpid",
+ *		   or to ECHILD if the command failed
+ */
+static int wait_for_git(pid_t pid)
+{
+	int status;
+
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR) {
+			return -1;
+		}
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errno = ECHILD;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Stop SIGPIPE from being delivered while writing to git,
+ * so that if git has stopped, the write fails with EPIPE
+ * rather than killing the whole process.
+ * old_mask:	stores the signal mask to restore with "allow_sigpipe"
+ */
+static void block_sigpipe(sigset_t *old_mask)
+{
+	sigset_t pipe_mask;
+
+	sigemptyset(&pipe_mask);
+	sigaddset(&pipe_mask, SIGPIPE);
+	sigprocmask(SIG_BLOCK, &pipe_mask, old_mask);
+}
+
+/*
+ * Restore the signal mask changed by "block_sigpipe",
+ * first discarding any SIGPIPE raised by writing to git,
+ * unless SIGPIPE was already blocked.
+ * old_mask:	the signal mask to restore
+ */
+static void allow_sigpipe(const sigset_t *old_mask)
+{
+	static const struct timespec no_wait = {0, 0};
+	sigset_t pipe_mask, pending;
+	int error = errno;
+
+	sigemptyset(&pipe_mask);
+	sigaddset(&pipe_mask, SIGPIPE);
+	if (!sigismember(old_mask, SIGPIPE) && !sigpending(&pending) &&
+	    sigismember(&pending, SIGPIPE)) {
+		sigtimedwait(&pipe_mask, NULL, &no_wait);
+	}
+	sigprocmask(SIG_SETMASK, old_mask, NULL);
+	errno = error;
+}
+
+int open_git_source(struct git_source *source, const char *repo_path,
+		    const char *base_rev, const char *rev)
+{
+	/* Paths are relative to the top of the repository either way. */
+	const char *list_argv[] = {
+		GIT_COMMAND, "-C", repo_path, "ls-tree", "-r", "-z",
+		"--full-tree", rev, NULL
+	};
+	const char *diff_argv[] = {
+		GIT_COMMAND, "-C", repo_path, "diff-tree", "-r", "-z",
+		"--diff-filter=d", base_rev, rev, NULL
+	};
+	const char *batch_argv[] = {
+		GIT_COMMAND, "-C", repo_path, "cat-file", "--batch", NULL
+	};
+	int error;
+
+	memset(source, 0, sizeof(*source));
+	source->is_diff = base_rev != NULL;
+
+	if (spawn_git(source->is_diff ? diff_argv : list_argv,
+		      &source->list_pid, NULL, &source->list)) {
+		return -1;
+	}
+	if (spawn_git(batch_argv, &source->batch_pid, &source->batch_in,
+		      &source->batch_out)) {
+		error = errno;
+		fclose(source->list);
+		waitpid(source->list_pid, NULL, 0);
+		errno = error;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Cut off the first field of a record at a separator.
+ * field:	the record, starting with the field
+ * separator:	the character ending the field
+ * returns	the rest of the record, after the separator,
+ *		or NULL if there is no separator
+ */
+static char *split_field(char *field, char separator)
+{
+	char *end = strchr(field, separator);
+
+	if (end == NULL) {
+		return NULL;
+	}
+	*end = '\0';
+	return end + 1;
+}
+
+/*
+ * Read the next file in the list.
+ * The list from "git ls-tree" has a record for each file,
+ * "[mode] [type] [object]\t[path]",
+ * while the list from "git diff-tree" has two,
+ * ":[old mode] [new mode] [old object] [new object] [status]",
+ * then "[path]".
+ * source:	the list of files
+ * mode:	stores the mode of the file, in octal
+ * object:	stores the name of the file's blob
+ * path:	stores the path of the file
+ * returns	1 if a file was found,
+ *		0 at the end of the list,
+ *		-1 on failure, with errno set by "getdelim",
+ *		   or to EPROTO if a record could not be understood
+ */
+static int next_list_entry(struct git_source *source, const char **mode,
+			   const char **object, const char **path)
+{
+	char *fields[5] = {NULL};
+	size_t i;
+
+	if (getdelim(&source->record, &source->record_capacity, '\0',
+		     source->list) < 0) {
+		return ferror(source->list) ? -1 : 0;
+	}
+
+	if (!source->is_diff) {
+		fields[0] = source->record;
+		for (i = 1; i < 4 && fields[i - 1] != NULL; i++) {
+			fields[i] = split_field(fields[i - 1],
+						i < 3 ? ' ' : '\t');
+		}
+		if (fields[3] == NULL) {
+			errno = EPROTO;
+			return -1;
+		}
+		*mode = fields[0];
+		*object = fields[2];
+		*path = fields[3];
+		return 1;
+	}
+
+	if (source->record[0] != ':') {
+		errno = EPROTO;
+		return -1;
+	}
+	fields[0] = source->record + 1;
+	for (i = 1; i < 5 && fields[i - 1] != NULL; i++) {
+		fields[i] = split_field(fields[i - 1], ' ');
+	}
+	if (fields[4] == NULL) {
+		errno = EPROTO;
+		return -1;
+	}
+	if (getdelim(&source->path, &source->path_capacity, '\0',
+		     source->list) < 0) {
+		if (!ferror(source->list)) {
+			errno = EPROTO;
+		}
+		return -1;
+	}
+	*mode = fields[1];
+	*object = fields[3];
+	*path = source->path;
+	return 1;
+}
+
+int next_git_blob(struct git_source *source, const char **path,
+		  size_t *size)
+{
+	const char *mode, *object;
+	char *type, *size_text, *size_end;
+	ssize_t header_length;
+	sigset_t old_mask;
+	int found, error;
+
+	/* Symbolic links and submodules have no text to search. */
+	do {
+		found = next_list_entry(source, &mode, &object, path);
+		if (found <= 0) {
+			return found;
+		}
+	} while (!S_ISREG(strtoul(mode, NULL, 8)));
+
+	/* Without "--buffer", git answers as soon as it reads the name. */
+	block_sigpipe(&old_mask);
+	error = fprintf(source->batch_in, "%s\n", object) < 0 ||
+		fflush(source->batch_in);
+	allow_sigpipe(&old_mask);
+	if (error) {
+		return -1;
+	}
+
+	/* The header is "[object] blob [size]\n". */
+	header_length = getline(&source->header, &source->header_capacity,
+				source->batch_out);
+	if (header_length <= 0 ||
+	    source->header[header_length - 1] != '\n') {
+		if (!ferror(source->batch_out)) {
+			errno = EPROTO;
+		}
+		return -1;
+	}
+	source->header[header_length - 1] = '\0';
+	type = split_field(source->header, ' ');
+	size_text = type == NULL ? NULL : split_field(type, ' ');
+	if (size_text == NULL || strcmp(type, "blob") != 0) {
+		errno = EPROTO;
+		return -1;
+	}
+	errno = 0;
+	*size = strtoull(size_text, &size_end, 10);
+	if (errno != 0 || size_end == size_text || *size_end != '\0') {
+		errno = EPROTO;
+		return -1;
+	}
+	return 1;
+}
+
+int read_git_blob(struct git_source *source, char *data, size_t size)
+{
+	/* Each blob is followed by a line break. */
+	if (fread(data, 1, size, source->batch_out) != size ||
+	    getc(source->batch_out) != '\n') {
+		if (!ferror(source->batch_out)) {
+			errno = EPROTO;
+		}
+		return -1;
+	}
+	return 0;
+}
+
+int close_git_source(struct git_source *source)
+{
+	sigset_t old_mask;
+	int error = 0;
+
+	/*
+	 * Closing its input lets "git cat-file" finish.
+	 * A name left unwritten after a failure is written by "fclose".
+	 */
+	block_sigpipe(&old_mask);
+	fclose(source->batch_in);
+	allow_sigpipe(&old_mask);
+	fclose(source->batch_out);
+	fclose(source->list);
+	if (wait_for_git(source->batch_pid)) {
+		error = -1;
+	}
+	if (wait_for_git(source->list_pid)) {
+		error = -1;
+	}
+
+	free(source->record);
+	free(source->path);
+	free(source->header);
+	return error;
+}
@@ -0,0 +1,132 @@
+#include <inode_set.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* the number of slots in a new table, which must be a power of 2 */
+#define INITIAL_CAPACITY	64
+
+/*
+ * Allocate an empty table.
+ * set:		the set whose table to allocate
+ * capacity:	the number of slots, which must be a power of 2
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "calloc"
+ */
+static int alloc_table(struct inode_set *set, size_t capacity)
+{
+	set->keys = calloc(capacity, sizeof(*set->keys));
+	set->used = calloc(capacity, sizeof(*set->used));
+	if (set->keys == NULL || set->used == NULL) {
+		free(set->keys);
+		free(set->used);
+		return -1;
+	}
+
+	set->capacity = capacity;
+	set->size = 0;
+	return 0;
+}
+
+int init_inode_set(struct inode_set *set)
+{
+	return alloc_table(set, INITIAL_CAPACITY);
+}
+
+void destroy_inode_set(struct inode_set *set)
+{
+	free(set->keys);
+	free(set->used);
+}
+
+/*
+ * Mix the device and inode numbers,
+ * so that consecutive inode numbers are spread across the table.
+ * device:	the device containing the file
+ * inode:	the inode number of the file
+ * returns	the hash of the file's identity
+ */
+static uint64_t hash_inode(dev_t device, ino_t inode)
+{
+	uint64_t hash = (uint64_t) inode ^ ((uint64_t) device << 32 |
+					    (uint64_t) device >> 32);
+
+	/* the finalizer of "splitmix64" */
+	hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+	return hash ^ (hash >> 31);
+}
+
+/*
+ * Find the slot holding a file, or the empty slot where it belongs.
+ * set:		the set to search
+ * device:	the device containing the file
+ * inode:	the inode number of the file
+ * returns	the index of the slot
+ */
+static size_t find_slot(const struct inode_set *set, dev_t device,
+			ino_t inode)
+{
+	size_t mask = set->capacity - 1;
+	size_t slot_i = hash_inode(device, inode) & mask;
+
+	while (set->used[slot_i] && (set->keys[slot_i].device != device ||
+				     set->keys[slot_i].inode != inode)) {
+		slot_i = (slot_i + 1) & mask;
+	}
+	return slot_i;
+}
+
+/*
+ * Double the size of the table, and move the keys into the new table.
+ * set:		the set to grow
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "calloc",
+ *		   in which case the set is unchanged
+ */
+static int grow_table(struct inode_set *set)
+{
+	struct inode_set old_set = *set;
+	size_t slot_i;
+
+	if (alloc_table(set, old_set.capacity * 2)) {
+		*set = old_set;
+		return -1;
+	}
+
+	for (slot_i = 0; slot_i < old_set.capacity; slot_i++) {
+		if (old_set.used[slot_i]) {
+			struct inode_key *key = old_set.keys + slot_i;
+			size_t new_slot_i = find_slot(set, key->device,
+						      key->inode);
+
+			set->keys[new_slot_i] = *key;
+			set->used[new_slot_i] = 1;
+			set->size++;
+		}
+	}
+
+	destroy_inode_set(&old_set);
+	return 0;
+}
+
+int add_inode(struct inode_set *set, dev_t device, ino_t inode)
+{
+	size_t slot_i;
+
+	/* Keep the table at most half full, so that probes stay short. */
+	if ((set->size + 1) * 2 > set->capacity && grow_table(set)) {
+		return -1;
+	}
+
+	slot_i = find_slot(set, device, inode);
+	if (set->used[slot_i]) {
+		return 0;
+	}
+
+	set->keys[slot_i].device = device;
+	set->keys[slot_i].inode = inode;
+	set->used[slot_i] = 1;
+	set->size++;
+	return 1;
+}
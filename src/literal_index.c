@@ -0,0 +1,1008 @@
+#define _GNU_SOURCE
+#include <literal_index.h>
+
+#include <byte_hash.h>
+#include <logger.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* the number of elements for which to make room at first */
+#define INITIAL_CAPACITY	1024
+/* the value of an unused slot in the table of strings */
+#define NO_LITERAL		UINT32_MAX
+/* the largest number of files, strings or appearances in an index */
+#define MAX_ID			(UINT32_MAX - 1)
+
+/*
+ * Make room for at least one more element in an array,
+ * doubling its size if it is full.
+ * array:	the array, which may be replaced
+ * capacity:	the number of elements for which there is room,
+ *		which is updated
+ * size:	the number of elements in use
+ * element_size:	the size of each element
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "realloc",
+ *		   in which case the array is unchanged
+ */
+static int reserve(void **array, size_t *capacity, size_t size,
+		   size_t element_size)
+{
+	size_t new_capacity;
+	void *new_array;
+
+	if (size < *capacity) {
+		return 0;
+	}
+
+	new_capacity = *capacity == 0 ? INITIAL_CAPACITY : *capacity * 2;
+	if ((new_array = realloc(*array, new_capacity * element_size)) ==
+	    NULL) {
+		return -1;
+	}
+	*array = new_array;
+	*capacity = new_capacity;
+	return 0;
+}
+
+/*
+ * Allocate an empty table of strings.
+ * builder:	the index whose table to allocate
+ * capacity:	the number of slots, which must be a power of 2
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "malloc"
+ */
+static int alloc_literal_table(struct index_builder *builder, size_t capacity)
+{
+	size_t slot_i;
+
+	builder->literal_table = malloc(capacity *
+					sizeof(*builder->literal_table));
+	if (builder->literal_table == NULL) {
+		return -1;
+	}
+
+	for (slot_i = 0; slot_i < capacity; slot_i++) {
+		builder->literal_table[slot_i] = NO_LITERAL;
+	}
+	builder->literal_table_capacity = capacity;
+	return 0;
+}
+
+/*
+ * Double the room for distinct strings.
+ * builder:	the index whose strings to make room for
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "realloc",
+ *		   in which case the strings are unchanged
+ */
+static int grow_literals(struct index_builder *builder)
+{
+	size_t new_capacity = builder->literals_capacity == 0 ?
+			      INITIAL_CAPACITY :
+			      builder->literals_capacity * 2;
+	uint64_t *new_offsets, *new_hashes;
+
+	new_offsets = realloc(builder->literal_offsets,
+			      new_capacity * sizeof(*new_offsets));
+	if (new_offsets == NULL) {
+		return -1;
+	}
+	builder->literal_offsets = new_offsets;
+
+	new_hashes = realloc(builder->literal_hashes,
+			     new_capacity * sizeof(*new_hashes));
+	if (new_hashes == NULL) {
+		return -1;
+	}
+	builder->literal_hashes = new_hashes;
+	builder->literals_capacity = new_capacity;
+	return 0;
+}
+
+int init_index_builder(struct index_builder *builder)
+{
+	memset(builder, 0, sizeof(*builder));
+
+	/* Keep the end of the last string after the last offset. */
+	if (grow_literals(builder) ||
+	    alloc_literal_table(builder, INITIAL_CAPACITY)) {
+		free(builder->literal_offsets);
+		free(builder->literal_hashes);
+		return -1;
+	}
+	builder->literal_offsets[0] = 0;
+	return 0;
+}
+
+void destroy_index_builder(struct index_builder *builder)
+{
+	free(builder->file_pool);
+	free(builder->file_offsets);
+	free(builder->literal_pool);
+	free(builder->literal_offsets);
+	free(builder->literal_hashes);
+	free(builder->literal_table);
+	free(builder->occurrences);
+}
+
+/*
+ * Append bytes to a pool, growing it as needed.
+ * pool:	the pool, which may be replaced
+ * size:	the number of bytes in use, which is updated
+ * capacity:	the number of bytes allocated, which is updated
+ * bytes:	the bytes to append
+ * length:	the number of bytes to append
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "realloc",
+ *		   in which case the pool is unchanged
+ */
+static int append_bytes(char **pool, size_t *size, size_t *capacity,
+			const char *bytes, size_t length)
+{
+	if (*size + length > *capacity) {
+		size_t new_capacity = *capacity == 0 ? INITIAL_CAPACITY :
+						       *capacity;
+		char *new_pool;
+
+		while (new_capacity < *size + length) {
+			new_capacity *= 2;
+		}
+		if ((new_pool = realloc(*pool, new_capacity)) == NULL) {
+			return -1;
+		}
+		*pool = new_pool;
+		*capacity = new_capacity;
+	}
+
+	memcpy(*pool + *size, bytes, length);
+	*size += length;
+	return 0;
+}
+
+int add_index_file(struct index_builder *builder, const char *path)
+{
+	if (builder->n_files >= MAX_ID) {
+		errno = EOVERFLOW;
+		return -1;
+	}
+	if (reserve((void **) &builder->file_offsets,
+		    &builder->files_capacity, builder->n_files,
+		    sizeof(*builder->file_offsets))) {
+		return -1;
+	}
+
+	builder->file_offsets[builder->n_files] = builder->file_pool_size;
+	if (append_bytes(&builder->file_pool, &builder->file_pool_size,
+			 &builder->file_pool_capacity, path,
+			 strlen(path) + 1)) {
+		return -1;
+	}
+	builder->n_files++;
+	return 0;
+}
+
+/*
+ * Find the slot in the table for a string,
+ * or the unused slot where it belongs.
+ * builder:	the index to search
+ * string:	the string to find
+ * length:	the length of the string
+ * hash:	the hash of the string
+ * returns	the slot
+ */
+static uint32_t *find_literal_slot(const struct index_builder *builder,
+				   const char *string, size_t length,
+				   uint64_t hash)
+{
+	size_t mask = builder->literal_table_capacity - 1;
+	size_t slot_i = hash & mask;
+
+	for (;; slot_i = (slot_i + 1) & mask) {
+		uint32_t *slot = builder->literal_table + slot_i;
+		const uint64_t *offsets;
+
+		if (*slot == NO_LITERAL) {
+			return slot;
+		}
+
+		offsets = builder->literal_offsets + *slot;
+		if (builder->literal_hashes[*slot] == hash &&
+		    offsets[1] - offsets[0] == length &&
+		    memcmp(builder->literal_pool + offsets[0], string,
+			   length) == 0) {
+			return slot;
+		}
+	}
+}
+
+/*
+ * Double the size of the table of strings,
+ * and move the strings into the new table.
+ * builder:	the index whose table to grow
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "malloc",
+ *		   in which case the table is unchanged
+ */
+static int grow_literal_table(struct index_builder *builder)
+{
+	uint32_t *old_table = builder->literal_table;
+	size_t old_capacity = builder->literal_table_capacity;
+	size_t mask;
+	uint32_t literal_id;
+
+	if (alloc_literal_table(builder, old_capacity * 2)) {
+		builder->literal_table = old_table;
+		builder->literal_table_capacity = old_capacity;
+		return -1;
+	}
+
+	/* The strings are distinct, so only look for unused slots. */
+	mask = builder->literal_table_capacity - 1;
+	for (literal_id = 0; literal_id < builder->n_literals; literal_id++) {
+		size_t slot_i = builder->literal_hashes[literal_id] & mask;
+
+		while (builder->literal_table[slot_i] != NO_LITERAL) {
+			slot_i = (slot_i + 1) & mask;
+		}
+		builder->literal_table[slot_i] = literal_id;
+	}
+
+	free(old_table);
+	return 0;
+}
+
+/*
+ * Add a string to the set of distinct strings, if it is not there yet.
+ * builder:	the index to which to add the string
+ * string:	the string to add
+ * length:	the length of the string
+ * literal_id:	stores the index of the string
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "realloc" or "malloc",
+ *		   or to EOVERFLOW if there are too many strings
+ */
+static int intern_literal(struct index_builder *builder, const char *string,
+			  size_t length, uint32_t *literal_id)
+{
+	uint64_t hash = hash_bytes(string, length);
+	uint32_t *slot;
+
+	if ((builder->n_literals + 1) * 2 > builder->literal_table_capacity &&
+	    grow_literal_table(builder)) {
+		return -1;
+	}
+
+	slot = find_literal_slot(builder, string, length, hash);
+	if (*slot != NO_LITERAL) {
+		*literal_id = *slot;
+		return 0;
+	}
+
+	if (builder->n_literals >= MAX_ID) {
+		errno = EOVERFLOW;
+		return -1;
+	}
+	if (builder->n_literals + 1 >= builder->literals_capacity &&
+	    grow_literals(builder)) {
+		return -1;
+	}
+	if (append_bytes(&builder->literal_pool, &builder->literal_pool_size,
+			 &builder->literal_pool_capacity, string, length)) {
+		return -1;
+	}
+
+	*literal_id = builder->n_literals++;
+	*slot = *literal_id;
+	builder->literal_hashes[*literal_id] = hash;
+	builder->literal_offsets[builder->n_literals] =
+		builder->literal_pool_size;
+	return 0;
+}
+
+int add_index_string(struct index_builder *builder, const char *string,
+		     size_t length, size_t line_number)
+{
+	struct index_occurrence *occurrence;
+	uint32_t literal_id;
+
+	if (builder->n_occurrences >= MAX_ID) {
+		errno = EOVERFLOW;
+		return -1;
+	}
+	if (intern_literal(builder, string, length, &literal_id) ||
+	    reserve((void **) &builder->occurrences,
+		    &builder->occurrences_capacity, builder->n_occurrences,
+		    sizeof(*builder->occurrences))) {
+		return -1;
+	}
+
+	occurrence = builder->occurrences + builder->n_occurrences++;
+	occurrence->literal_id = literal_id;
+	occurrence->location.file_id = builder->n_files - 1;
+	occurrence->location.line_number = line_number;
+	return 0;
+}
+
+/* the bytes at the start of every index */
+#define INDEX_MAGIC		"SFINDEX1"
+#define INDEX_MAGIC_LEN		(sizeof(INDEX_MAGIC) - 1)
+/* a value whose bytes show the byte order of the host */
+#define BYTE_ORDER_MARK		0x01020304
+/* the alignment of each section in the index */
+#define SECTION_ALIGNMENT	sizeof(uint64_t)
+
+/*
+ * the header at the start of an index,
+ * which is followed by the sections that it locates.
+ * All numbers are in the byte order of the host that wrote the index,
+ * so that the index can be used directly once it is mapped into memory.
+ */
+struct index_header {
+	/* "INDEX_MAGIC" */
+	char magic[INDEX_MAGIC_LEN];
+	/* "BYTE_ORDER_MARK" */
+	uint32_t byte_order;
+	/* always 0 */
+	uint32_t reserved;
+	/* the number of files, distinct strings and appearances */
+	uint64_t n_files;
+	uint64_t n_literals;
+	uint64_t n_locations;
+	/* the number of distinct three-byte sequences in the strings */
+	uint64_t n_trigrams;
+	/* the total length of the lists of strings per sequence */
+	uint64_t n_postings;
+	/* the offset of each section from the start of the index */
+	/* uint64_t[n_files + 1]: the offset of each path in "file_pool" */
+	uint64_t file_offsets_start;
+	/* the paths of the files, each terminated by '\0' */
+	uint64_t file_pool_start;
+	/* uint64_t[n_literals + 1]: the offset of each string */
+	uint64_t literal_offsets_start;
+	/* the distinct strings, one after another */
+	uint64_t literal_pool_start;
+	/* uint64_t[n_literals + 1]: the first appearance of each string */
+	uint64_t location_starts_start;
+	/* struct index_location[n_locations]: appearances, by string */
+	uint64_t locations_start;
+	/* uint32_t[n_trigrams]: the sorted three-byte sequences */
+	uint64_t trigram_keys_start;
+	/* uint64_t[n_trigrams + 1]: the first string for each sequence */
+	uint64_t posting_starts_start;
+	/* uint32_t[n_postings]: the sorted strings for each sequence */
+	uint64_t postings_start;
+	/* the size of the whole index */
+	uint64_t index_size;
+};
+
+/* the number of bytes in a three-byte sequence */
+#define TRIGRAM_LEN	3
+
+/*
+ * Pack three bytes into an integer.
+ * bytes:	the first of the three bytes
+ * returns	the three-byte sequence, in the low 24 bits
+ */
+static uint32_t get_trigram(const char *bytes)
+{
+	const unsigned char *unsigned_bytes = (const unsigned char *) bytes;
+
+	return (uint32_t) unsigned_bytes[0] << 16 |
+	       (uint32_t) unsigned_bytes[1] << 8 | unsigned_bytes[2];
+}
+
+/*
+ * Order pairs of sequences and strings, for "qsort".
+ * first:	the first pair to compare
+ * second:	the second pair to compare
+ * returns	negative if the first pair comes first,
+ *		positive if it comes second,
+ *		and 0 if the pairs are equal
+ */
+static int compare_pairs(const void *first, const void *second)
+{
+	uint64_t first_pair = *(const uint64_t *) first;
+	uint64_t second_pair = *(const uint64_t *) second;
+
+	return (first_pair > second_pair) - (first_pair < second_pair);
+}
+
+/* the lists of strings containing each three-byte sequence */
+struct posting_lists {
+	uint32_t *keys;		/* the sorted, distinct sequences */
+	uint64_t *starts;	/* the start of the list for each sequence */
+	uint32_t *postings;	/* the lists, one after another */
+	size_t n_trigrams;	/* the number of distinct sequences */
+	size_t n_postings;	/* the total length of the lists */
+};
+
+/*
+ * Build the list of the strings containing each three-byte sequence.
+ * builder:	the index containing the strings
+ * lists:	stores the lists,
+ *		whose arrays must be freed if this function succeeds
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "malloc"
+ */
+static int build_posting_lists(const struct index_builder *builder,
+			       struct posting_lists *lists)
+{
+	size_t n_pairs = 0;
+	uint64_t *pairs;
+	size_t literal_id, pair_i;
+
+	for (literal_id = 0; literal_id < builder->n_literals; literal_id++) {
+		size_t length = builder->literal_offsets[literal_id + 1] -
+				builder->literal_offsets[literal_id];
+
+		if (length >= TRIGRAM_LEN) {
+			n_pairs += length - TRIGRAM_LEN + 1;
+		}
+	}
+
+	pairs = malloc((n_pairs + 1) * sizeof(*pairs));
+	lists->keys = malloc((n_pairs + 1) * sizeof(*lists->keys));
+	lists->starts = malloc((n_pairs + 2) * sizeof(*lists->starts));
+	lists->postings = malloc((n_pairs + 1) * sizeof(*lists->postings));
+	if (pairs == NULL || lists->keys == NULL || lists->starts == NULL ||
+	    lists->postings == NULL) {
+		free(pairs);
+		free(lists->keys);
+		free(lists->starts);
+		free(lists->postings);
+		return -1;
+	}
+
+	/* Sort (sequence, string) pairs, so that lists come out in order. */
+	n_pairs = 0;
+	for (literal_id = 0; literal_id < builder->n_literals; literal_id++) {
+		const char *literal = builder->literal_pool +
+				      builder->literal_offsets[literal_id];
+		const char *literal_end = builder->literal_pool +
+					  builder->literal_offsets[literal_id +
+								   1];
+
+		for (; literal_end - literal >= TRIGRAM_LEN; literal++) {
+			pairs[n_pairs++] = (uint64_t) get_trigram(literal) <<
+					   32 | literal_id;
+		}
+	}
+	qsort(pairs, n_pairs, sizeof(*pairs), compare_pairs);
+
+	lists->n_trigrams = 0;
+	lists->n_postings = 0;
+	for (pair_i = 0; pair_i < n_pairs; pair_i++) {
+		uint32_t trigram = pairs[pair_i] >> 32;
+
+		if (pair_i > 0 && pairs[pair_i] == pairs[pair_i - 1]) {
+			/* The sequence appears several times in the string. */
+			continue;
+		}
+		if (lists->n_trigrams == 0 ||
+		    lists->keys[lists->n_trigrams - 1] != trigram) {
+			lists->keys[lists->n_trigrams] = trigram;
+			lists->starts[lists->n_trigrams++] = lists->n_postings;
+		}
+		lists->postings[lists->n_postings++] = (uint32_t) pairs[pair_i];
+	}
+	lists->starts[lists->n_trigrams] = lists->n_postings;
+
+	free(pairs);
+	return 0;
+}
+
+/*
+ * Group the appearances by string, keeping the order in which
+ * the appearances of each string were found.
+ * builder:	the index containing the appearances
+ * starts:	stores the start of the appearances of each string,
+ *		and must have room for one more than the number of strings
+ * locations:	stores the grouped appearances
+ */
+static void group_locations(const struct index_builder *builder,
+			    uint64_t *starts, struct index_location *locations)
+{
+	size_t literal_id, occurrence_i;
+
+	memset(starts, 0, (builder->n_literals + 1) * sizeof(*starts));
+	for (occurrence_i = 0; occurrence_i < builder->n_occurrences;
+	     occurrence_i++) {
+		starts[builder->occurrences[occurrence_i].literal_id + 1]++;
+	}
+	for (literal_id = 0; literal_id < builder->n_literals; literal_id++) {
+		starts[literal_id + 1] += starts[literal_id];
+	}
+
+	/* Use the start of the next group as the next free position. */
+	for (occurrence_i = 0; occurrence_i < builder->n_occurrences;
+	     occurrence_i++) {
+		const struct index_occurrence *occurrence =
+			builder->occurrences + occurrence_i;
+
+		locations[starts[occurrence->literal_id]++] =
+			occurrence->location;
+	}
+	for (literal_id = builder->n_literals; literal_id > 0; literal_id--) {
+		starts[literal_id] = starts[literal_id - 1];
+	}
+	starts[0] = 0;
+}
+
+/*
+ * Round a size up to the alignment of the sections.
+ * size:	the size to round
+ * returns	the rounded size
+ */
+static uint64_t align_section(uint64_t size)
+{
+	return (size + SECTION_ALIGNMENT - 1) & ~(uint64_t)
+	       (SECTION_ALIGNMENT - 1);
+}
+
+/*
+ * Write a section of the index, followed by padding to the next section.
+ * out:		the output stream to which to write
+ * section:	the contents of the section
+ * size:	the size of the section
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "fwrite"
+ */
+static int write_section(FILE *out, const void *section, uint64_t size)
+{
+	static const char padding[SECTION_ALIGNMENT];
+	size_t padding_size = align_section(size) - size;
+
+	if (size > 0 && fwrite(section, 1, size, out) != size) {
+		return -1;
+	}
+	return fwrite(padding, 1, padding_size, out) == padding_size ? 0 : -1;
+}
+
+int write_index(const struct index_builder *builder, FILE *out)
+{
+	struct index_header header;
+	struct posting_lists lists;
+	uint64_t *file_offsets;
+	uint64_t *location_starts;
+	struct index_location *locations;
+	uint64_t position;
+	int error = -1;
+
+	file_offsets = malloc((builder->n_files + 1) * sizeof(*file_offsets));
+	location_starts = malloc((builder->n_literals + 1) *
+				 sizeof(*location_starts));
+	locations = malloc((builder->n_occurrences + 1) * sizeof(*locations));
+	if (file_offsets == NULL || location_starts == NULL ||
+	    locations == NULL) {
+		goto free_arrays;
+	}
+	if (build_posting_lists(builder, &lists)) {
+		goto free_arrays;
+	}
+
+	if (builder->n_files > 0) {
+		memcpy(file_offsets, builder->file_offsets,
+		       builder->n_files * sizeof(*file_offsets));
+	}
+	file_offsets[builder->n_files] = builder->file_pool_size;
+	group_locations(builder, location_starts, locations);
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, INDEX_MAGIC, INDEX_MAGIC_LEN);
+	header.byte_order = BYTE_ORDER_MARK;
+	header.n_files = builder->n_files;
+	header.n_literals = builder->n_literals;
+	header.n_locations = builder->n_occurrences;
+	header.n_trigrams = lists.n_trigrams;
+	header.n_postings = lists.n_postings;
+
+	position = align_section(sizeof(header));
+	header.file_offsets_start = position;
+	position += align_section((header.n_files + 1) *
+				  sizeof(*file_offsets));
+	header.file_pool_start = position;
+	position += align_section(builder->file_pool_size);
+	header.literal_offsets_start = position;
+	position += align_section((header.n_literals + 1) *
+				  sizeof(*builder->literal_offsets));
+	header.literal_pool_start = position;
+	position += align_section(builder->literal_pool_size);
+	header.location_starts_start = position;
+	position += align_section((header.n_literals + 1) *
+				  sizeof(*location_starts));
+	header.locations_start = position;
+	position += align_section(header.n_locations * sizeof(*locations));
+	header.trigram_keys_start = position;
+	position += align_section(header.n_trigrams * sizeof(*lists.keys));
+	header.posting_starts_start = position;
+	position += align_section((header.n_trigrams + 1) *
+				  sizeof(*lists.starts));
+	header.postings_start = position;
+	position += align_section(header.n_postings * sizeof(*lists.postings));
+	header.index_size = position;
+
+	if (write_section(out, &header, sizeof(header)) ||
+	    write_section(out, file_offsets,
+			  (header.n_files + 1) * sizeof(*file_offsets)) ||
+	    write_section(out, builder->file_pool, builder->file_pool_size) ||
+	    write_section(out, builder->literal_offsets,
+			  (header.n_literals + 1) *
+			  sizeof(*builder->literal_offsets)) ||
+	    write_section(out, builder->literal_pool,
+			  builder->literal_pool_size) ||
+	    write_section(out, location_starts,
+			  (header.n_literals + 1) * sizeof(*location_starts)) ||
+	    write_section(out, locations,
+			  header.n_locations * sizeof(*locations)) ||
+	    write_section(out, lists.keys,
+			  header.n_trigrams * sizeof(*lists.keys)) ||
+	    write_section(out, lists.starts,
+			  (header.n_trigrams + 1) * sizeof(*lists.starts)) ||
+	    write_section(out, lists.postings,
+			  header.n_postings * sizeof(*lists.postings))) {
+		goto free_lists;
+	}
+	error = 0;
+
+free_lists:
+	free(lists.keys);
+	free(lists.starts);
+	free(lists.postings);
+free_arrays:
+	free(file_offsets);
+	free(location_starts);
+	free(locations);
+	return error;
+}
+
+/* an index mapped into memory */
+struct mapped_index {
+	/* the header, at the start of the mapping */
+	const struct index_header *header;
+	/* the sections, as described in "struct index_header" */
+	const uint64_t *file_offsets;
+	const char *file_pool;
+	const uint64_t *literal_offsets;
+	const char *literal_pool;
+	const uint64_t *location_starts;
+	const struct index_location *locations;
+	const uint32_t *trigram_keys;
+	const uint64_t *posting_starts;
+	const uint32_t *postings;
+};
+
+/*
+ * Check that a section lies within the index.
+ * start:		the offset of the section
+ * n_elements:		the number of elements in the section
+ * element_size:	the size of each element
+ * index_size:		the size of the index
+ * returns		1 if the section is within the index, 0 otherwise
+ */
+static int section_fits(uint64_t start, uint64_t n_elements,
+			size_t element_size, uint64_t index_size)
+{
+	return start % SECTION_ALIGNMENT == 0 && start <= index_size &&
+	       n_elements <= (index_size - start) / element_size;
+}
+
+/*
+ * Locate the sections of an index mapped into memory,
+ * checking that they lie within it.
+ * index:	stores the sections
+ * mapping:	the start of the mapping
+ * size:	the size of the mapping
+ * returns	0 on success,
+ *		-1 if the mapping is not a valid index
+ */
+static int locate_sections(struct mapped_index *index, const char *mapping,
+			   uint64_t size)
+{
+	const struct index_header *header = (const struct index_header *)
+					    mapping;
+
+	if (size < sizeof(*header) ||
+	    memcmp(header->magic, INDEX_MAGIC, INDEX_MAGIC_LEN) != 0 ||
+	    header->byte_order != BYTE_ORDER_MARK ||
+	    header->index_size != size ||
+	    header->n_files >= UINT64_MAX / 2 ||
+	    header->n_literals >= UINT64_MAX / 2 ||
+	    header->n_trigrams >= UINT64_MAX / 2 ||
+	    !section_fits(header->file_offsets_start, header->n_files + 1,
+			  sizeof(uint64_t), size) ||
+	    !section_fits(header->literal_offsets_start,
+			  header->n_literals + 1, sizeof(uint64_t), size) ||
+	    !section_fits(header->location_starts_start,
+			  header->n_literals + 1, sizeof(uint64_t), size) ||
+	    !section_fits(header->locations_start, header->n_locations,
+			  sizeof(struct index_location), size) ||
+	    !section_fits(header->trigram_keys_start, header->n_trigrams,
+			  sizeof(uint32_t), size) ||
+	    !section_fits(header->posting_starts_start,
+			  header->n_trigrams + 1, sizeof(uint64_t), size) ||
+	    !section_fits(header->postings_start, header->n_postings,
+			  sizeof(uint32_t), size)) {
+		return -1;
+	}
+
+	index->header = header;
+	index->file_offsets = (const uint64_t *)
+			      (mapping + header->file_offsets_start);
+	index->file_pool = mapping + header->file_pool_start;
+	index->literal_offsets = (const uint64_t *)
+				 (mapping + header->literal_offsets_start);
+	index->literal_pool = mapping + header->literal_pool_start;
+	index->location_starts = (const uint64_t *)
+				 (mapping + header->location_starts_start);
+	index->locations = (const struct index_location *)
+			   (mapping + header->locations_start);
+	index->trigram_keys = (const uint32_t *)
+			      (mapping + header->trigram_keys_start);
+	index->posting_starts = (const uint64_t *)
+				(mapping + header->posting_starts_start);
+	index->postings = (const uint32_t *)
+			  (mapping + header->postings_start);
+
+	/*
+	 * Check the ends of the pools, which the last offsets point to.
+	 * The other offsets are checked where they are used.
+	 */
+	if (!section_fits(header->file_pool_start,
+			  index->file_offsets[header->n_files], 1, size) ||
+	    !section_fits(header->literal_pool_start,
+			  index->literal_offsets[header->n_literals], 1,
+			  size) ||
+	    index->location_starts[header->n_literals] !=
+	    header->n_locations ||
+	    index->posting_starts[header->n_trigrams] != header->n_postings) {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Find the list of strings containing a three-byte sequence.
+ * index:	the index in which to search
+ * trigram:	the sequence to find
+ * list_start:	stores the start of the list
+ * list_end:	stores the end of the list
+ * returns	1 if the sequence was found, 0 otherwise,
+ *		or -1 if the index is inconsistent
+ */
+static int find_posting_list(const struct mapped_index *index,
+			     uint32_t trigram, const uint32_t **list_start,
+			     const uint32_t **list_end)
+{
+	size_t low = 0;
+	size_t high = index->header->n_trigrams;
+	uint64_t posting_start, posting_end;
+
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+
+		if (index->trigram_keys[middle] < trigram) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+
+	if (low == index->header->n_trigrams ||
+	    index->trigram_keys[low] != trigram) {
+		return 0;
+	}
+	posting_start = index->posting_starts[low];
+	posting_end = index->posting_starts[low + 1];
+	if (posting_start > posting_end ||
+	    posting_end > index->header->n_postings) {
+		return -1;
+	}
+	*list_start = index->postings + posting_start;
+	*list_end = index->postings + posting_end;
+	return 1;
+}
+
+/*
+ * Check if a sorted list of strings contains a string.
+ * list_start:	the start of the list
+ * list_end:	the end of the list
+ * literal_id:	the string to find
+ * returns	1 if the string is in the list, 0 otherwise
+ */
+static int list_contains(const uint32_t *list_start, const uint32_t *list_end,
+			 uint32_t literal_id)
+{
+	while (list_start < list_end) {
+		const uint32_t *middle = list_start +
+					 (list_end - list_start) / 2;
+
+		if (*middle == literal_id) {
+			return 1;
+		} else if (*middle < literal_id) {
+			list_start = middle + 1;
+		} else {
+			list_end = middle;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Print every appearance of a string, if it contains the substring.
+ * out:			the output stream to which to print
+ * index:		the index containing the string
+ * literal_id:		the string to check
+ * substring:		the substring to find
+ * substring_len:	the length of the substring
+ * returns		0 on success,
+ *			-1 if the index is inconsistent
+ */
+static int print_if_match(FILE *out, const struct mapped_index *index,
+			  uint32_t literal_id, const char *substring,
+			  size_t substring_len)
+{
+	uint64_t literal_start = index->literal_offsets[literal_id];
+	uint64_t literal_end = index->literal_offsets[literal_id + 1];
+	uint64_t location_i = index->location_starts[literal_id];
+	uint64_t location_end = index->location_starts[literal_id + 1];
+	const char *literal = index->literal_pool + literal_start;
+
+	if (literal_start > literal_end ||
+	    literal_end > index->literal_offsets[index->header->n_literals] ||
+	    location_i > location_end ||
+	    location_end > index->header->n_locations) {
+		return -1;
+	}
+	if (memmem(literal, literal_end - literal_start, substring,
+		   substring_len) == NULL) {
+		return 0;
+	}
+
+	for (; location_i < location_end; location_i++) {
+		const struct index_location *location = index->locations +
+							location_i;
+		uint64_t file_pool_size =
+			index->file_offsets[index->header->n_files];
+		uint64_t path_start;
+
+		if (location->file_id >= index->header->n_files ||
+		    (path_start = index->file_offsets[location->file_id]) >=
+		    file_pool_size) {
+			return -1;
+		}
+		/* Never read past the pool, even if a path is unterminated. */
+		fprintf(out, "%.*s (%u):\t",
+			(int) (file_pool_size - path_start),
+			index->file_pool + path_start,
+			(unsigned) location->line_number);
+		fwrite(literal, 1, literal_end - literal_start, out);
+		fprintf(out, "\n");
+	}
+	return 0;
+}
+
+/*
+ * Print the appearances of the strings in an index
+ * that contain a substring.
+ * out:		the output stream to which to print
+ * index:	the index in which to search
+ * substring:	the substring to find
+ * returns	0 on success,
+ *		-1 if the index is inconsistent
+ */
+static int _query_index(FILE *out, const struct mapped_index *index,
+			const char *substring)
+{
+	size_t substring_len = strlen(substring);
+	size_t n_trigrams = substring_len >= TRIGRAM_LEN ?
+			    substring_len - TRIGRAM_LEN + 1 : 0;
+	const uint32_t *list_starts[n_trigrams + 1];
+	const uint32_t *list_ends[n_trigrams + 1];
+	const uint32_t *candidate, *candidates_end;
+	size_t shortest = 0;
+	size_t trigram_i;
+
+	if (n_trigrams == 0) {
+		/* Too short to use the lists, so check every string. */
+		uint32_t literal_id;
+
+		for (literal_id = 0; literal_id < index->header->n_literals;
+		     literal_id++) {
+			if (print_if_match(out, index, literal_id, substring,
+					   substring_len)) {
+				return -1;
+			}
+		}
+		return 0;
+	}
+
+	for (trigram_i = 0; trigram_i < n_trigrams; trigram_i++) {
+		int found = find_posting_list(index,
+					      get_trigram(substring +
+							  trigram_i),
+					      list_starts + trigram_i,
+					      list_ends + trigram_i);
+
+		if (found <= 0) {
+			/* No string contains it, or the index is corrupt. */
+			return found;
+		}
+		if (list_ends[trigram_i] - list_starts[trigram_i] <
+		    list_ends[shortest] - list_starts[shortest]) {
+			shortest = trigram_i;
+		}
+	}
+
+	/*
+	 * Only check the strings in the shortest list
+	 * that are also in all the other lists.
+	 */
+	candidates_end = list_ends[shortest];
+	for (candidate = list_starts[shortest]; candidate < candidates_end;
+	     candidate++) {
+		int in_all = 1;
+
+		if (*candidate >= index->header->n_literals) {
+			return -1;
+		}
+		for (trigram_i = 0; in_all && trigram_i < n_trigrams;
+		     trigram_i++) {
+			in_all = trigram_i == shortest ||
+				 list_contains(list_starts[trigram_i],
+					       list_ends[trigram_i],
+					       *candidate);
+		}
+		if (in_all && print_if_match(out, index, *candidate, substring,
+					     substring_len)) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int query_index(FILE *out, const char *index_path, const char *substring)
+{
+	struct mapped_index index;
+	struct stat index_stat;
+	void *mapping;
+	int index_fd = open(index_path, O_RDONLY);
+	int error;
+
+	if (index_fd < 0) {
+		printlg(ERROR_LEVEL, "Failed to open index %s.\n", index_path);
+		return -1;
+	}
+	if (fstat(index_fd, &index_stat) || index_stat.st_size == 0) {
+		printlg(ERROR_LEVEL, "Failed to get size of index %s.\n",
+			index_path);
+		close(index_fd);
+		return -1;
+	}
+
+	mapping = mmap(NULL, index_stat.st_size, PROT_READ, MAP_PRIVATE,
+		       index_fd, 0);
+	close(index_fd);
+	if (mapping == MAP_FAILED) {
+		printlg(ERROR_LEVEL, "Failed to map index %s.\n", index_path);
+		return -1;
+	}
+
+	if (locate_sections(&index, mapping, index_stat.st_size)) {
+		printlg(ERROR_LEVEL, "%s is not a valid index.\n", index_path);
+		errno = EINVAL;
+		error = -1;
+	} else if ((error = _query_index(out, &index, substring))) {
+		printlg(ERROR_LEVEL, "Index %s is corrupt.\n", index_path);
+		errno = EINVAL;
+	}
+
+	munmap(mapping, index_stat.st_size);
+	return error;
+}
@@ -0,0 +1,621 @@
+#include <scan_kernels.h>
+
+#include <string.h>
+
+/* the lowest byte that is a printable ASCII character */
+#define FIRST_PRINTABLE	0x20
+/* the ASCII delete character, which is the only non-printable byte above */
+#define DELETE_CHAR	0x7f
+/* the lowest byte that is not ASCII */
+#define FIRST_NON_ASCII	0x80
+/* the first of the whitespace control characters */
+#define FIRST_SPACE	'\t'
+/* the last of the whitespace control characters */
+#define LAST_SPACE	'\r'
+
+/*
+ * Check if a byte is a control character, other than whitespace.
+ * byte_value:	the byte to check
+ * returns	1 if the byte is a non-whitespace control character,
+ *		0 otherwise
+ */
+static int is_control(unsigned char byte_value)
+{
+	return (byte_value < FIRST_PRINTABLE &&
+		!(byte_value >= FIRST_SPACE && byte_value <= LAST_SPACE)) ||
+	       byte_value == DELETE_CHAR;
+}
+
+/*
+ * Find the first byte in a range that matches either of two values,
+ * one byte at a time.
+ * start:	the first byte to check
+ * end:		the end of the range, which will not be checked
+ * first:	the first value to look for
+ * second:	the second value to look for
+ * returns	the position of the first matching byte,
+ *		or "end" if there is none
+ */
+static const char *scalar_find_either_byte(const char *start,
+					   const char *end,
+					   char first, char second)
+{
+	while (start < end && *start != first && *start != second) {
+		start++;
+	}
+	return start;
+}
+
+/*
+ * Count the bytes in a range that match a value, one byte at a time.
+ * start:	the first byte to check
+ * end:		the end of the range, which will not be checked
+ * target:	the value to count
+ * returns	the number of matching bytes
+ */
+static size_t scalar_count_byte(const char *start, const char *end,
+				char target)
+{
+	size_t count = 0;
+
+	for (; start < end; start++) {
+		count += *start == target;
+	}
+	return count;
+}
+
+/*
+ * Check that a range only contains ASCII text, one byte at a time.
+ * start:	the first byte to check
+ * end:		the end of the range, which will not be checked
+ * returns	1 if all bytes are text, 0 otherwise
+ */
+static int scalar_is_ascii_text(const char *start, const char *end)
+{
+	for (; start < end; start++) {
+		unsigned char byte_value = *start;
+
+		if (byte_value >= FIRST_NON_ASCII || is_control(byte_value)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* the smallest code point that needs two bytes */
+#define MIN_TWO_BYTE		0x80
+/* the smallest code point that needs three bytes */
+#define MIN_THREE_BYTE		0x800
+/* the smallest code point that needs four bytes */
+#define MIN_FOUR_BYTE		0x10000
+/* the largest valid code point */
+#define MAX_CODE_POINT		0x10ffff
+/* the range of code points reserved for UTF-16 surrogates */
+#define MIN_SURROGATE		0xd800
+#define MAX_SURROGATE		0xdfff
+/* the bits that mark a continuation byte, and their expected value */
+#define CONTINUATION_MASK	0xc0
+#define CONTINUATION_BITS	0x80
+/* the payload bits in a continuation byte */
+#define CONTINUATION_PAYLOAD	0x3f
+/* the number of payload bits in a continuation byte */
+#define CONTINUATION_SHIFT	6
+
+/*
+ * Check that a range is valid UTF-8 text, one code point at a time.
+ * start:	the first byte to check
+ * end:		the end of the range, which will not be checked
+ * returns	1 if the range is valid UTF-8 text, 0 otherwise
+ */
+static int scalar_is_utf8_text(const char *start, const char *end)
+{
+	const unsigned char *cursor = (const unsigned char *) start;
+	const unsigned char *bytes_end = (const unsigned char *) end;
+
+	while (cursor < bytes_end) {
+		unsigned char lead = *cursor;
+		unsigned long code_point, min_code_point;
+		size_t length, byte_i;
+
+		if (lead < FIRST_NON_ASCII) {
+			if (is_control(lead)) {
+				return 0;
+			}
+			cursor++;
+			continue;
+		}
+
+		if ((lead & 0xe0) == 0xc0) {
+			length = 2;
+			code_point = lead & 0x1f;
+			min_code_point = MIN_TWO_BYTE;
+		} else if ((lead & 0xf0) == 0xe0) {
+			length = 3;
+			code_point = lead & 0x0f;
+			min_code_point = MIN_THREE_BYTE;
+		} else if ((lead & 0xf8) == 0xf0) {
+			length = 4;
+			code_point = lead & 0x07;
+			min_code_point = MIN_FOUR_BYTE;
+		} else {
+			/* unexpected continuation, or invalid lead byte */
+			return 0;
+		}
+
+		if ((size_t) (bytes_end - cursor) < length) {
+			return 0;
+		}
+		for (byte_i = 1; byte_i < length; byte_i++) {
+			if ((cursor[byte_i] & CONTINUATION_MASK) !=
+			    CONTINUATION_BITS) {
+				return 0;
+			}
+			code_point = (code_point << CONTINUATION_SHIFT) |
+				     (cursor[byte_i] & CONTINUATION_PAYLOAD);
+		}
+
+		if (code_point < min_code_point ||
+		    code_point > MAX_CODE_POINT ||
+		    (code_point >= MIN_SURROGATE &&
+		     code_point <= MAX_SURROGATE)) {
+			return 0;
+		}
+		cursor += length;
+	}
+	return 1;
+}
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#include <tmmintrin.h>
+
+/* the number of bytes compared at once */
+#define VECTOR_SIZE	sizeof(__m128i)
+
+const char *find_either_byte(const char *start, const char *end,
+			     char first, char second)
+{
+	const __m128i first_vector = _mm_set1_epi8(first);
+	const __m128i second_vector = _mm_set1_epi8(second);
+
+	while ((size_t) (end - start) >= VECTOR_SIZE) {
+		__m128i block = _mm_loadu_si128((const __m128i *) start);
+		__m128i matches = _mm_or_si128(_mm_cmpeq_epi8(block,
+							      first_vector),
+					       _mm_cmpeq_epi8(block,
+							      second_vector));
+		unsigned mask = _mm_movemask_epi8(matches);
+
+		if (mask != 0) {
+			return start + __builtin_ctz(mask);
+		}
+		start += VECTOR_SIZE;
+	}
+
+	while (start < end && *start != first && *start != second) {
+		start++;
+	}
+	return start;
+}
+
+size_t count_byte(const char *start, const char *end, char target)
+{
+	const __m128i target_vector = _mm_set1_epi8(target);
+	size_t count = 0;
+
+	while ((size_t) (end - start) >= VECTOR_SIZE) {
+		__m128i block = _mm_loadu_si128((const __m128i *) start);
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block,
+								 target_vector));
+
+		count += __builtin_popcount(mask);
+		start += VECTOR_SIZE;
+	}
+
+	for (; start < end; start++) {
+		count += *start == target;
+	}
+	return count;
+}
+
+/* "_mm_movemask_epi8" result when the condition holds in every byte */
+#define ALL_BYTES_MASK	0xffff
+
+/*
+ * Find the whitespace control characters in a block.
+ * Bytes are compared as signed values,
+ * so non-ASCII bytes count as negative, and never match.
+ * block:	the bytes to check
+ * returns	0xff in each byte that is whitespace, and 0 elsewhere
+ */
+static __m128i find_spaces(__m128i block)
+{
+	return _mm_and_si128(_mm_cmpgt_epi8(block,
+					    _mm_set1_epi8(FIRST_SPACE - 1)),
+			     _mm_cmplt_epi8(block,
+					    _mm_set1_epi8(LAST_SPACE + 1)));
+}
+
+/*
+ * Find the control characters, other than whitespace, in a block.
+ * block:	the bytes to check
+ * returns	0xff in each byte that is a non-whitespace control
+ *		character, and 0 elsewhere
+ */
+static __m128i find_controls(__m128i block)
+{
+	__m128i low = _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8(-1)),
+				    _mm_cmplt_epi8(block,
+						   _mm_set1_epi8(FIRST_PRINTABLE)));
+
+	return _mm_or_si128(_mm_andnot_si128(find_spaces(block), low),
+			    _mm_cmpeq_epi8(block, _mm_set1_epi8(DELETE_CHAR)));
+}
+
+int is_ascii_text(const char *start, const char *end)
+{
+	while ((size_t) (end - start) >= VECTOR_SIZE) {
+		__m128i block = _mm_loadu_si128((const __m128i *) start);
+		__m128i printable =
+			_mm_and_si128(_mm_cmpgt_epi8(block,
+						     _mm_set1_epi8(FIRST_PRINTABLE
+								   - 1)),
+				      _mm_cmplt_epi8(block,
+						     _mm_set1_epi8(DELETE_CHAR)));
+		__m128i text = _mm_or_si128(printable, find_spaces(block));
+
+		if (_mm_movemask_epi8(text) != ALL_BYTES_MASK) {
+			return 0;
+		}
+		start += VECTOR_SIZE;
+	}
+
+	return scalar_is_ascii_text(start, end);
+}
+
+/*
+ * The UTF-8 validator below classifies each pair of adjacent bytes
+ * with three table lookups, following the method of
+ * Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte".
+ * Each bit marks a kind of error that the pair may be part of,
+ * and a pair is only invalid if all three lookups agree on a bit.
+ */
+#define SSSE3_TARGET	__attribute__((target("ssse3")))
+
+/* lead byte followed by a non-continuation byte */
+#define TOO_SHORT	(1 << 0)
+/* ASCII byte followed by a continuation byte */
+#define TOO_LONG	(1 << 1)
+/* three-byte sequence encoding a code point below 0x800 */
+#define OVERLONG_3	(1 << 2)
+/* four-byte sequence encoding a code point above 0x10ffff */
+#define TOO_LARGE	(1 << 3)
+/* three-byte sequence encoding a UTF-16 surrogate */
+#define SURROGATE	(1 << 4)
+/* two-byte sequence encoding a code point below 0x80 */
+#define OVERLONG_2	(1 << 5)
+/* four-byte sequence encoding a code point above 0x10ffff or below 0x10000 */
+#define TOO_LARGE_1000	(1 << 6)
+#define OVERLONG_4	(1 << 6)
+/* two continuation bytes in a row, which is fine within a longer sequence */
+#define TWO_CONTS	(1 << 7)
+/* errors that do not depend on the low bits of the first byte */
+#define CARRY		(TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+/*
+ * Get the high four bits of each byte.
+ * block:	the bytes to shift
+ * returns	the high nibble of each byte, in its low bits
+ */
+static __m128i high_nibbles(__m128i block)
+{
+	return _mm_and_si128(_mm_srli_epi16(block, 4), _mm_set1_epi8(0x0f));
+}
+
+/*
+ * Find the invalid UTF-8 sequences ending in a block.
+ * block:		the bytes to check
+ * previous_block:	the bytes immediately before the block
+ * returns		non-zero bytes wherever an error was found
+ */
+SSSE3_TARGET static __m128i check_utf8_block(__m128i block,
+					     __m128i previous_block)
+{
+	const __m128i byte_1_high_table =
+		_mm_setr_epi8(TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+			      TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+			      TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+			      TOO_SHORT | OVERLONG_2,
+			      TOO_SHORT,
+			      TOO_SHORT | OVERLONG_3 | SURROGATE,
+			      (char) (TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 |
+				      OVERLONG_4));
+	const __m128i byte_1_low_table =
+		_mm_setr_epi8((char) (CARRY | OVERLONG_3 | OVERLONG_2 |
+				      OVERLONG_4),
+			      (char) (CARRY | OVERLONG_2),
+			      (char) CARRY,
+			      (char) CARRY,
+			      (char) (CARRY | TOO_LARGE),
+			      (char) (CARRY | TOO_LARGE | TOO_LARGE_1000),
+			      (char) (CARRY | TOO_LARGE | TOO_LARGE_1000),
+			      (char) (CARRY | TOO_LARGE | TOO_LARGE_1000),
+			      (char) (CARRY | TOO_LARGE | TOO_LARGE_1000),
+			      (char) (CARRY | TOO_LARGE | TOO_LARGE_1000),
+			      (char) (CARRY | TOO_LARGE | TOO_LARGE_1000),
+			      (char) (CARRY | TOO_LARGE | TOO_LARGE_1000),
+			      (char) (CARRY | TOO_LARGE | TOO_LARGE_1000),
+			      (char) (CARRY | TOO_LARGE | TOO_LARGE_1000 |
+				      SURROGATE),
+			      (char) (CARRY | TOO_LARGE | TOO_LARGE_1000),
+			      (char) (CARRY | TOO_LARGE | TOO_LARGE_1000));
+	const __m128i byte_2_high_table =
+		_mm_setr_epi8(TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+			      TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+			      (char) (TOO_LONG | OVERLONG_2 | TWO_CONTS |
+				      OVERLONG_3 | TOO_LARGE_1000 |
+				      OVERLONG_4),
+			      (char) (TOO_LONG | OVERLONG_2 | TWO_CONTS |
+				      OVERLONG_3 | TOO_LARGE),
+			      (char) (TOO_LONG | OVERLONG_2 | TWO_CONTS |
+				      SURROGATE | TOO_LARGE),
+			      (char) (TOO_LONG | OVERLONG_2 | TWO_CONTS |
+				      SURROGATE | TOO_LARGE),
+			      TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+	__m128i previous_1 = _mm_alignr_epi8(block, previous_block, 15);
+	__m128i previous_2 = _mm_alignr_epi8(block, previous_block, 14);
+	__m128i previous_3 = _mm_alignr_epi8(block, previous_block, 13);
+	__m128i byte_1_high = _mm_shuffle_epi8(byte_1_high_table,
+					       high_nibbles(previous_1));
+	__m128i byte_1_low = _mm_shuffle_epi8(byte_1_low_table,
+					      _mm_and_si128(previous_1,
+							    _mm_set1_epi8(0x0f)));
+	__m128i byte_2_high = _mm_shuffle_epi8(byte_2_high_table,
+					       high_nibbles(block));
+	__m128i special_cases = _mm_and_si128(_mm_and_si128(byte_1_high,
+							    byte_1_low),
+					      byte_2_high);
+	/*
+	 * Two continuations in a row are only allowed
+	 * as the third or fourth byte of a sequence,
+	 * ie. two bytes after a three or four byte lead,
+	 * or three bytes after a four byte lead.
+	 */
+	__m128i third_byte = _mm_subs_epu8(previous_2,
+					   _mm_set1_epi8((char) (0xe0 - 0x80)));
+	__m128i fourth_byte = _mm_subs_epu8(previous_3,
+					    _mm_set1_epi8((char) (0xf0 - 0x80)));
+	__m128i must_continue = _mm_and_si128(_mm_or_si128(third_byte,
+							   fourth_byte),
+					      _mm_set1_epi8((char) 0x80));
+
+	return _mm_xor_si128(must_continue, special_cases);
+}
+
+/*
+ * Find the lead bytes at the end of a block
+ * that need more continuation bytes than the block has left.
+ * block:	the bytes to check
+ * returns	non-zero bytes wherever a sequence is left incomplete
+ */
+static __m128i find_incomplete(__m128i block)
+{
+	const __m128i max_complete =
+		_mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+			      -1, -1, -1, -1, -1,
+			      (char) (0xf0 - 1), (char) (0xe0 - 1),
+			      (char) (0xc0 - 1));
+
+	return _mm_subs_epu8(block, max_complete);
+}
+
+/*
+ * Validate UTF-8 text a block at a time,
+ * skipping the table lookups for blocks that are entirely ASCII.
+ * start:	the first byte to check
+ * end:		the end of the range, which will not be checked
+ * returns	1 if the range is valid UTF-8 text, 0 otherwise
+ */
+SSSE3_TARGET static int ssse3_is_utf8_text(const char *start, const char *end)
+{
+	__m128i error = _mm_setzero_si128();
+	__m128i previous_block = _mm_setzero_si128();
+	__m128i previous_incomplete = _mm_setzero_si128();
+
+	while (start < end) {
+		__m128i block;
+
+		if ((size_t) (end - start) >= VECTOR_SIZE) {
+			block = _mm_loadu_si128((const __m128i *) start);
+			start += VECTOR_SIZE;
+		} else {
+			/* Pad the last block with spaces, which are valid. */
+			char tail[VECTOR_SIZE];
+
+			memset(tail, ' ', sizeof(tail));
+			memcpy(tail, start, end - start);
+			block = _mm_loadu_si128((const __m128i *) tail);
+			start = end;
+		}
+
+		error = _mm_or_si128(error, find_controls(block));
+		if (_mm_movemask_epi8(block) == 0) {
+			/* An ASCII block cannot finish an earlier sequence. */
+			error = _mm_or_si128(error, previous_incomplete);
+			previous_incomplete = _mm_setzero_si128();
+		} else {
+			error = _mm_or_si128(error,
+					     check_utf8_block(block,
+							      previous_block));
+			previous_incomplete = find_incomplete(block);
+		}
+		previous_block = block;
+
+		/* Stop early on binary files. */
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(error,
+						     _mm_setzero_si128())) !=
+		    ALL_BYTES_MASK) {
+			return 0;
+		}
+	}
+
+	error = _mm_or_si128(error, previous_incomplete);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) ==
+	       ALL_BYTES_MASK;
+}
+
+int is_utf8_text(const char *start, const char *end)
+{
+	if (__builtin_cpu_supports("ssse3")) {
+		return ssse3_is_utf8_text(start, end);
+	}
+	return scalar_is_utf8_text(start, end);
+}
+
+/*
+ * The AVX2 kernels below compare 32 bytes at a time,
+ * and leave the rest of the range to the SSE2 kernels.
+ * They are only used if the CPU supports AVX2,
+ * so the rest of the program does not need to be built for it.
+ */
+#define AVX2_TARGET	__attribute__((target("avx2")))
+#include <immintrin.h>
+
+/* the number of bytes compared at once by the AVX2 kernels */
+#define WIDE_VECTOR_SIZE	sizeof(__m256i)
+/* "_mm256_movemask_epi8" result when the condition holds in every byte */
+#define ALL_WIDE_BYTES_MASK	0xffffffffu
+
+/* "find_either_byte", 32 bytes at a time */
+AVX2_TARGET static const char *avx2_find_either_byte(const char *start,
+						     const char *end,
+						     char first, char second)
+{
+	const __m256i first_vector = _mm256_set1_epi8(first);
+	const __m256i second_vector = _mm256_set1_epi8(second);
+
+	while ((size_t) (end - start) >= WIDE_VECTOR_SIZE) {
+		__m256i block = _mm256_loadu_si256((const __m256i *) start);
+		__m256i matches =
+			_mm256_or_si256(_mm256_cmpeq_epi8(block, first_vector),
+					_mm256_cmpeq_epi8(block,
+							  second_vector));
+		unsigned mask = _mm256_movemask_epi8(matches);
+
+		if (mask != 0) {
+			return start + __builtin_ctz(mask);
+		}
+		start += WIDE_VECTOR_SIZE;
+	}
+	return find_either_byte(start, end, first, second);
+}
+
+/* "count_byte", 32 bytes at a time */
+AVX2_TARGET static size_t avx2_count_byte(const char *start, const char *end,
+					  char target)
+{
+	const __m256i target_vector = _mm256_set1_epi8(target);
+	size_t count = 0;
+
+	while ((size_t) (end - start) >= WIDE_VECTOR_SIZE) {
+		__m256i block = _mm256_loadu_si256((const __m256i *) start);
+		unsigned mask =
+			_mm256_movemask_epi8(_mm256_cmpeq_epi8(block,
+							       target_vector));
+
+		count += __builtin_popcount(mask);
+		start += WIDE_VECTOR_SIZE;
+	}
+	return count + count_byte(start, end, target);
+}
+
+/* "is_ascii_text", 32 bytes at a time */
+AVX2_TARGET static int avx2_is_ascii_text(const char *start, const char *end)
+{
+	const __m256i below_printable = _mm256_set1_epi8(FIRST_PRINTABLE - 1);
+	const __m256i delete_char = _mm256_set1_epi8(DELETE_CHAR);
+	const __m256i below_space = _mm256_set1_epi8(FIRST_SPACE - 1);
+	const __m256i after_space = _mm256_set1_epi8(LAST_SPACE + 1);
+
+	while ((size_t) (end - start) >= WIDE_VECTOR_SIZE) {
+		__m256i block = _mm256_loadu_si256((const __m256i *) start);
+		/* Non-ASCII bytes are negative, so they are neither. */
+		__m256i printable =
+			_mm256_and_si256(_mm256_cmpgt_epi8(block,
+							   below_printable),
+					 _mm256_cmpgt_epi8(delete_char, block));
+		__m256i spaces =
+			_mm256_and_si256(_mm256_cmpgt_epi8(block, below_space),
+					 _mm256_cmpgt_epi8(after_space, block));
+		unsigned mask =
+			_mm256_movemask_epi8(_mm256_or_si256(printable,
+							     spaces));
+
+		if (mask != ALL_WIDE_BYTES_MASK) {
+			return 0;
+		}
+		start += WIDE_VECTOR_SIZE;
+	}
+	return is_ascii_text(start, end);
+}
+
+static const struct scan_kernels sse2_kernels = {
+	find_either_byte, count_byte, is_ascii_text, is_utf8_text
+};
+/* UTF-8 is still validated 16 bytes at a time. */
+static const struct scan_kernels avx2_kernels = {
+	avx2_find_either_byte, avx2_count_byte, avx2_is_ascii_text,
+	is_utf8_text
+};
+#else /* __SSE2__ */
+const char *find_either_byte(const char *start, const char *end,
+			     char first, char second)
+{
+	return scalar_find_either_byte(start, end, first, second);
+}
+
+size_t count_byte(const char *start, const char *end, char target)
+{
+	return scalar_count_byte(start, end, target);
+}
+
+int is_ascii_text(const char *start, const char *end)
+{
+	return scalar_is_ascii_text(start, end);
+}
+
+int is_utf8_text(const char *start, const char *end)
+{
+	return scalar_is_utf8_text(start, end);
+}
+#endif /* __SSE2__ */
+
+static const struct scan_kernels scalar_kernels = {
+	scalar_find_either_byte, scalar_count_byte, scalar_is_ascii_text,
+	scalar_is_utf8_text
+};
+
+const struct scan_kernels *get_scan_kernels(enum scan_kernel_level level)
+{
+	switch (level) {
+	case SCALAR_KERNELS:
+		return &scalar_kernels;
+#ifdef __SSE2__
+	case SSE2_KERNELS:
+		return &sse2_kernels;
+	case AVX2_KERNELS:
+		return __builtin_cpu_supports("avx2") ? &avx2_kernels : NULL;
+#endif /* __SSE2__ */
+	default:
+		return NULL;
+	}
+}
+
+enum scan_kernel_level best_scan_kernel_level(void)
+{
+	enum scan_kernel_level level = N_KERNEL_LEVELS;
+
+	while (get_scan_kernels(--level) == NULL) {
+	}
+	return level;
+}
@@ -0,0 +1,269 @@
+#define _GNU_SOURCE
+#include <shard.h>
+
+#include <byte_hash.h>
+#include <logger.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+void print_shard_record(FILE *out, size_t ordinal)
+{
+	fprintf(out, "%c%lu\n", SHARD_RECORD_MARKER, (unsigned long) ordinal);
+}
+
+unsigned shard_of_path(const char *relative_path, unsigned n_shards)
+{
+	return hash_bytes(relative_path, strlen(relative_path)) % n_shards;
+}
+
+void init_shard_plan(struct shard_plan *plan)
+{
+	plan->files = NULL;
+	plan->n_files = 0;
+	plan->capacity = 0;
+}
+
+void destroy_shard_plan(struct shard_plan *plan)
+{
+	free(plan->files);
+}
+
+/* the number of files for which to make room at first */
+#define INITIAL_CAPACITY	1024
+
+int add_planned_file(struct shard_plan *plan, const char *relative_path,
+		     uint64_t size)
+{
+	struct planned_file *file;
+
+	if (plan->n_files == plan->capacity) {
+		size_t new_capacity = plan->capacity == 0 ? INITIAL_CAPACITY :
+							    plan->capacity * 2;
+		struct planned_file *new_files =
+			realloc(plan->files,
+				new_capacity * sizeof(*new_files));
+
+		if (new_files == NULL) {
+			return -1;
+		}
+		plan->files = new_files;
+		plan->capacity = new_capacity;
+	}
+
+	file = plan->files + plan->n_files++;
+	file->path_hash = hash_bytes(relative_path, strlen(relative_path));
+	file->size = size;
+	file->shard_index = 0;
+	return 0;
+}
+
+/*
+ * Order files from largest to smallest, breaking ties by path hash,
+ * for "qsort".
+ * first:	the first file to compare
+ * second:	the second file to compare
+ * returns	negative if the first file comes first,
+ *		positive if it comes second,
+ *		and 0 if the files are equal
+ */
+static int compare_sizes(const void *first, const void *second)
+{
+	const struct planned_file *first_file = first;
+	const struct planned_file *second_file = second;
+
+	if (first_file->size != second_file->size) {
+		return first_file->size < second_file->size ? 1 : -1;
+	}
+	return (first_file->path_hash > second_file->path_hash) -
+	       (first_file->path_hash < second_file->path_hash);
+}
+
+/*
+ * Order files by path hash, for "qsort" and "bsearch".
+ * first:	the first file to compare
+ * second:	the second file to compare
+ * returns	negative if the first file comes first,
+ *		positive if it comes second,
+ *		and 0 if the files have the same path hash
+ */
+static int compare_path_hashes(const void *first, const void *second)
+{
+	uint64_t first_hash = ((const struct planned_file *) first)->path_hash;
+	uint64_t second_hash =
+		((const struct planned_file *) second)->path_hash;
+
+	return (first_hash > second_hash) - (first_hash < second_hash);
+}
+
+int make_shard_plan(struct shard_plan *plan, unsigned n_shards)
+{
+	uint64_t *loads = calloc(n_shards, sizeof(*loads));
+	size_t file_i;
+
+	if (loads == NULL) {
+		return -1;
+	}
+
+	/*
+	 * Give each file, from largest to smallest,
+	 * to the shard with the fewest bytes so far.
+	 */
+	qsort(plan->files, plan->n_files, sizeof(*plan->files),
+	      compare_sizes);
+	for (file_i = 0; file_i < plan->n_files; file_i++) {
+		struct planned_file *file = plan->files + file_i;
+		unsigned lightest = 0;
+		unsigned shard_i;
+
+		for (shard_i = 1; shard_i < n_shards; shard_i++) {
+			if (loads[shard_i] < loads[lightest]) {
+				lightest = shard_i;
+			}
+		}
+		file->shard_index = lightest;
+		/* Count each file as at least a byte, to spread empty files. */
+		loads[lightest] += file->size + 1;
+	}
+
+	qsort(plan->files, plan->n_files, sizeof(*plan->files),
+	      compare_path_hashes);
+	free(loads);
+	return 0;
+}
+
+unsigned planned_shard_of_path(const struct shard_plan *plan,
+			       const char *relative_path, unsigned n_shards)
+{
+	struct planned_file key;
+	const struct planned_file *file;
+
+	key.path_hash = hash_bytes(relative_path, strlen(relative_path));
+	file = bsearch(&key, plan->files, plan->n_files, sizeof(*plan->files),
+		       compare_path_hashes);
+	if (file == NULL) {
+		return shard_of_path(relative_path, n_shards);
+	}
+	return file->shard_index;
+}
+
+/* the output of a shard, as it is being merged */
+struct shard_input {
+	/* the output stream of the shard */
+	FILE *in;
+	/* the last line read from the shard */
+	char *line;
+	/* the size of the memory allocated for "line" */
+	size_t line_capacity;
+	/* the position of the next file in the shard's output */
+	unsigned long ordinal;
+	/* Has the beginning of a file been read yet? */
+	int started;
+	/* Has the whole output of the shard been read? */
+	int done;
+};
+
+/*
+ * Read lines from a shard's output until the next file begins,
+ * optionally copying them.
+ * input:	the shard's output, whose "ordinal" is updated
+ * out:		the output stream to which to copy the lines,
+ *		or NULL to check that there are none
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "getline" if reading failed,
+ *		   or to EINVAL if there were lines to copy,
+ *		   but nowhere to copy them,
+ *		   or if the files are out of order
+ */
+static int read_shard_record(struct shard_input *input, FILE *out)
+{
+	ssize_t line_len;
+
+	while ((line_len = getline(&input->line, &input->line_capacity,
+				   input->in)) >= 0) {
+		if (line_len > 0 && input->line[0] == SHARD_RECORD_MARKER) {
+			unsigned long ordinal = strtoul(input->line + 1,
+							NULL, 10);
+
+			if (input->started && ordinal <= input->ordinal) {
+				errno = EINVAL;
+				return -1;
+			}
+			input->ordinal = ordinal;
+			input->started = 1;
+			return 0;
+		}
+		if (out == NULL) {
+			errno = EINVAL;
+			return -1;
+		}
+		fwrite(input->line, 1, line_len, out);
+	}
+
+	input->done = 1;
+	return ferror(input->in) ? -1 : 0;
+}
+
+int merge_shard_outputs(FILE *out, FILE **inputs, size_t n_inputs)
+{
+	struct shard_input *shards = calloc(n_inputs, sizeof(*shards));
+	size_t shard_i;
+	int error = 0;
+
+	if (shards == NULL) {
+		return -1;
+	}
+
+	for (shard_i = 0; shard_i < n_inputs && !error; shard_i++) {
+		shards[shard_i].in = inputs[shard_i];
+		if (read_shard_record(shards + shard_i, NULL)) {
+			printlg(ERROR_LEVEL,
+				"Input %u is not the output of a shard.\n",
+				(unsigned) shard_i);
+			error = -1;
+		}
+	}
+
+	while (!error) {
+		struct shard_input *next = NULL;
+
+		/* Each shard's files are in order, so take the earliest. */
+		for (shard_i = 0; shard_i < n_inputs; shard_i++) {
+			struct shard_input *shard = shards + shard_i;
+
+			if (shard->done) {
+				continue;
+			}
+			if (next != NULL && shard->ordinal == next->ordinal) {
+				/* Each file is only searched by one shard. */
+				printlg(ERROR_LEVEL,
+					"Several shards searched file %lu, "
+					"so they are not of one search.\n",
+					shard->ordinal);
+				errno = EINVAL;
+				error = -1;
+				break;
+			}
+			if (next == NULL || shard->ordinal < next->ordinal) {
+				next = shard;
+			}
+		}
+		if (error || next == NULL) {
+			break;
+		}
+
+		if (read_shard_record(next, out)) {
+			printlg(ERROR_LEVEL, "Failed to read output of shard, "
+				"or its files are out of order.\n");
+			error = -1;
+		}
+	}
+
+	for (shard_i = 0; shard_i < n_inputs; shard_i++) {
+		free(shards[shard_i].line);
+	}
+	free(shards);
+	return error;
+}
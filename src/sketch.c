@@ -0,0 +1,758 @@
+#include <sketch.h>
+
+#include <binary_number.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+int init_hyperloglog(struct hyperloglog *hll, unsigned precision)
+{
+	hll->precision = precision;
+	hll->registers = calloc((size_t) 1 << precision,
+				sizeof(*hll->registers));
+	return hll->registers == NULL ? -1 : 0;
+}
+
+void destroy_hyperloglog(struct hyperloglog *hll)
+{
+	free(hll->registers);
+}
+
+void clear_hyperloglog(struct hyperloglog *hll)
+{
+	memset(hll->registers, 0,
+	       ((size_t) 1 << hll->precision) * sizeof(*hll->registers));
+}
+
+void add_hyperloglog(struct hyperloglog *hll, uint64_t hash)
+{
+	size_t register_i = hash >> (64 - hll->precision);
+	/* Stop at the last bit, which is always set. */
+	uint64_t rest = hash << hll->precision |
+			(uint64_t) 1 << (hll->precision - 1);
+	uint8_t rank = __builtin_clzll(rest) + 1;
+
+	if (rank > hll->registers[register_i]) {
+		hll->registers[register_i] = rank;
+	}
+}
+
+void merge_hyperloglog(struct hyperloglog *into,
+		       const struct hyperloglog *from)
+{
+	size_t register_i;
+
+	for (register_i = 0; register_i < (size_t) 1 << into->precision;
+	     register_i++) {
+		if (from->registers[register_i] >
+		    into->registers[register_i]) {
+			into->registers[register_i] =
+				from->registers[register_i];
+		}
+	}
+}
+
+/* the natural logarithm of 2 */
+#define LN_2	0.69314718055994530942
+/* the number of terms of the series for small logarithms */
+#define N_LOG_TERMS	16
+
+/*
+ * Calculate a natural logarithm,
+ * without needing to link against the math library.
+ * x:		the number, which must be at least 1
+ * returns	the natural logarithm of the number
+ */
+static double natural_log(double x)
+{
+	double z, z_squared, power, sum = 0;
+	unsigned n_halvings = 0;
+	unsigned term_i;
+
+	while (x >= 2) {
+		x /= 2;
+		n_halvings++;
+	}
+
+	/* ln(x) = 2 * atanh(z), which converges quickly for z <= 1/3. */
+	z = (x - 1) / (x + 1);
+	z_squared = z * z;
+	power = z;
+	for (term_i = 0; term_i < N_LOG_TERMS; term_i++) {
+		sum += power / (2 * term_i + 1);
+		power *= z_squared;
+	}
+
+	return n_halvings * LN_2 + 2 * sum;
+}
+
+double estimate_hyperloglog(const struct hyperloglog *hll)
+{
+	size_t n_registers = (size_t) 1 << hll->precision;
+	double m = n_registers;
+	double inverse_sum = 0;
+	double alpha, estimate;
+	size_t n_zeros = 0;
+	size_t register_i;
+
+	for (register_i = 0; register_i < n_registers; register_i++) {
+		uint8_t rank = hll->registers[register_i];
+
+		inverse_sum += 1.0 / ((uint64_t) 1 << rank);
+		n_zeros += rank == 0;
+	}
+
+	/* the bias correction from the paper by Flajolet et al. */
+	switch (n_registers) {
+	case 16:
+		alpha = 0.673;
+		break;
+	case 32:
+		alpha = 0.697;
+		break;
+	case 64:
+		alpha = 0.709;
+		break;
+	default:
+		alpha = 0.7213 / (1 + 1.079 / m);
+		break;
+	}
+	estimate = alpha * m * m / inverse_sum;
+
+	/* For few hashes, count the unused registers instead. */
+	if (estimate <= 2.5 * m && n_zeros > 0) {
+		estimate = m * natural_log(m / n_zeros);
+	}
+	return estimate;
+}
+
+/* the share of a sketch's memory given to the count of distinct strings */
+#define DISTINCT_SHARE		16
+/* the number of rows in the count-min sketch */
+#define COUNT_MIN_DEPTH		4
+/* the most rows that will be read from a saved sketch */
+#define MAX_COUNT_MIN_DEPTH	16
+/* the smallest and largest numbers of counters in each row */
+#define MIN_COUNT_MIN_WIDTH	64
+#define MAX_COUNT_MIN_WIDTH	((size_t) 1 << 30)
+/* the number of frequent strings to keep for each one that is printed */
+#define HITTERS_PER_TOP		4
+/* the most frequent strings that will be read from a saved sketch */
+#define MAX_HITTERS		(MAX_SKETCH_TOP * HITTERS_PER_TOP)
+
+/*
+ * Create an empty sketch of the given dimensions.
+ * sketch:	the sketch to initialize
+ * precision:	the precision of the count of distinct strings
+ * depth:	the number of rows in the count-min sketch
+ * width:	the number of counters in each row
+ * max_hitters:	the number of most frequent strings to keep
+ * n_top:	the number of most frequent strings to print
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "calloc"
+ */
+static int init_sketch_dimensions(struct string_sketch *sketch,
+				  unsigned precision, unsigned depth,
+				  size_t width, size_t max_hitters,
+				  size_t n_top)
+{
+	memset(sketch, 0, sizeof(*sketch));
+	if (init_hyperloglog(&sketch->distinct, precision)) {
+		return -1;
+	}
+
+	sketch->depth = depth;
+	sketch->width = width;
+	sketch->max_hitters = max_hitters;
+	sketch->n_top = n_top;
+	/* Keep the table at most half full, so that it is quick to search. */
+	sketch->n_hitter_slots = 1;
+	while (sketch->n_hitter_slots < max_hitters * 2) {
+		sketch->n_hitter_slots *= 2;
+	}
+	sketch->counters = calloc(depth * width, sizeof(*sketch->counters));
+	sketch->hitters = calloc(max_hitters + 1, sizeof(*sketch->hitters));
+	sketch->hitter_slots = calloc(sketch->n_hitter_slots,
+				      sizeof(*sketch->hitter_slots));
+	if (sketch->counters == NULL || sketch->hitters == NULL ||
+	    sketch->hitter_slots == NULL) {
+		destroy_string_sketch(sketch);
+		return -1;
+	}
+	return 0;
+}
+
+int init_string_sketch(struct string_sketch *sketch, size_t memory_size,
+		       size_t n_top)
+{
+	unsigned precision = MIN_HYPERLOGLOG_PRECISION;
+	size_t distinct_size, counters_size;
+	size_t width = MIN_COUNT_MIN_WIDTH;
+
+	if (n_top > MAX_SKETCH_TOP) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	while (precision < MAX_HYPERLOGLOG_PRECISION &&
+	       (size_t) 1 << (precision + 1) <= memory_size / DISTINCT_SHARE) {
+		precision++;
+	}
+
+	distinct_size = (size_t) 1 << precision;
+	counters_size = memory_size > distinct_size ?
+			memory_size - distinct_size : 0;
+	while (width < MAX_COUNT_MIN_WIDTH &&
+	       width * 2 * COUNT_MIN_DEPTH * sizeof(*sketch->counters) <=
+	       counters_size) {
+		width *= 2;
+	}
+
+	return init_sketch_dimensions(sketch, precision, COUNT_MIN_DEPTH,
+				      width, n_top * HITTERS_PER_TOP, n_top);
+}
+
+void destroy_string_sketch(struct string_sketch *sketch)
+{
+	destroy_hyperloglog(&sketch->distinct);
+	free(sketch->counters);
+	free(sketch->hitters);
+	free(sketch->hitter_slots);
+}
+
+/*
+ * Find the counter for a string in a row of the count-min sketch.
+ * Each row uses a different combination of two halves of the hash.
+ * sketch:	the sketch containing the counters
+ * hash:	the hash of the string
+ * row_i:	the row
+ * returns	the counter
+ */
+static uint64_t *find_counter(const struct string_sketch *sketch,
+			      uint64_t hash, unsigned row_i)
+{
+	uint32_t first_hash = hash;
+	uint32_t second_hash = (hash >> 32) | 1;
+	size_t column_i = (first_hash + (size_t) row_i * second_hash) &
+			  (sketch->width - 1);
+
+	return sketch->counters + row_i * sketch->width + column_i;
+}
+
+/*
+ * Estimate the number of appearances of a string.
+ * sketch:	the sketch to which the string was added
+ * hash:	the hash of the string
+ * returns	the estimate, which is never less than the true count
+ */
+static uint64_t estimate_count(const struct string_sketch *sketch,
+			       uint64_t hash)
+{
+	uint64_t count = UINT64_MAX;
+	unsigned row_i;
+
+	for (row_i = 0; row_i < sketch->depth; row_i++) {
+		uint64_t counter = *find_counter(sketch, hash, row_i);
+
+		if (counter < count) {
+			count = counter;
+		}
+	}
+	return count;
+}
+
+/*
+ * Find the slot of the table of frequent strings
+ * at which to start looking for a string.
+ * sketch:	the sketch containing the table
+ * hash:	the hash of the string
+ * returns	the index of the slot
+ */
+static size_t home_hitter_slot(const struct string_sketch *sketch,
+			       uint64_t hash)
+{
+	/* The low bits choose the counters, so mix in the high ones. */
+	return (size_t) (hash ^ (hash >> 32)) & (sketch->n_hitter_slots - 1);
+}
+
+/*
+ * Find the slot of the table of frequent strings
+ * holding a string, or the empty slot where it would be added.
+ * sketch:	the sketch containing the table
+ * hash:	the hash of the string
+ * returns	the index of the slot
+ */
+static size_t find_hitter_slot(const struct string_sketch *sketch,
+			       uint64_t hash)
+{
+	size_t slot_mask = sketch->n_hitter_slots - 1;
+	size_t slot_i = home_hitter_slot(sketch, hash);
+
+	while (sketch->hitter_slots[slot_i] != 0 &&
+	       sketch->hitters[sketch->hitter_slots[slot_i] - 1].hash !=
+	       hash) {
+		slot_i = (slot_i + 1) & slot_mask;
+	}
+	return slot_i;
+}
+
+/*
+ * Empty a slot of the table of frequent strings,
+ * moving back the strings after it that would no longer be found.
+ * sketch:	the sketch containing the table
+ * slot_i:	the index of the slot to empty
+ */
+static void remove_hitter_slot(struct string_sketch *sketch, size_t slot_i)
+{
+	size_t slot_mask = sketch->n_hitter_slots - 1;
+	size_t next_i = slot_i;
+
+	sketch->hitter_slots[slot_i] = 0;
+	for (;;) {
+		const struct heavy_hitter *next;
+		size_t home_i;
+
+		next_i = (next_i + 1) & slot_mask;
+		if (sketch->hitter_slots[next_i] == 0) {
+			return;
+		}
+		next = sketch->hitters + sketch->hitter_slots[next_i] - 1;
+		home_i = home_hitter_slot(sketch, next->hash);
+		/* A string found from its home slot stays where it is. */
+		if (((next_i - home_i) & slot_mask) <
+		    ((next_i - slot_i) & slot_mask)) {
+			continue;
+		}
+		sketch->hitter_slots[slot_i] = sketch->hitter_slots[next_i];
+		sketch->hitter_slots[next_i] = 0;
+		slot_i = next_i;
+	}
+}
+
+/*
+ * Swap two of the most frequent strings,
+ * and update their slots in the table.
+ * sketch:	the sketch containing the strings
+ * first_i:	the position of the first string
+ * second_i:	the position of the second string
+ */
+static void swap_hitters(struct string_sketch *sketch, size_t first_i,
+			 size_t second_i)
+{
+	struct heavy_hitter first = sketch->hitters[first_i];
+	size_t first_slot_i = find_hitter_slot(sketch, first.hash);
+	size_t second_slot_i =
+		find_hitter_slot(sketch, sketch->hitters[second_i].hash);
+
+	sketch->hitters[first_i] = sketch->hitters[second_i];
+	sketch->hitters[second_i] = first;
+	sketch->hitter_slots[first_slot_i] = second_i + 1;
+	sketch->hitter_slots[second_slot_i] = first_i + 1;
+}
+
+/*
+ * Move a frequent string towards the start of the heap,
+ * until it is no less frequent than the string before it.
+ * sketch:	the sketch containing the strings
+ * hitter_i:	the position of the string
+ */
+static void sift_hitter_up(struct string_sketch *sketch, size_t hitter_i)
+{
+	while (hitter_i > 0) {
+		size_t parent_i = (hitter_i - 1) / 2;
+
+		if (sketch->hitters[parent_i].count <=
+		    sketch->hitters[hitter_i].count) {
+			return;
+		}
+		swap_hitters(sketch, hitter_i, parent_i);
+		hitter_i = parent_i;
+	}
+}
+
+/*
+ * Move a frequent string towards the end of the heap,
+ * until it is no more frequent than the strings after it.
+ * sketch:	the sketch containing the strings
+ * hitter_i:	the position of the string
+ */
+static void sift_hitter_down(struct string_sketch *sketch, size_t hitter_i)
+{
+	for (;;) {
+		size_t least_i = hitter_i;
+		size_t child_i = hitter_i * 2 + 1;
+
+		if (child_i < sketch->n_hitters &&
+		    sketch->hitters[child_i].count <
+		    sketch->hitters[least_i].count) {
+			least_i = child_i;
+		}
+		if (child_i + 1 < sketch->n_hitters &&
+		    sketch->hitters[child_i + 1].count <
+		    sketch->hitters[least_i].count) {
+			least_i = child_i + 1;
+		}
+		if (least_i == hitter_i) {
+			return;
+		}
+		swap_hitters(sketch, hitter_i, least_i);
+		hitter_i = least_i;
+	}
+}
+
+/*
+ * Rebuild the heap and table of the most frequent strings,
+ * after their counts were changed or they were loaded.
+ * sketch:	the sketch containing the strings
+ * returns	0 on success,
+ *		-1 if a string is there twice, with errno set to EINVAL
+ */
+static int rebuild_hitters(struct string_sketch *sketch)
+{
+	size_t hitter_i;
+
+	memset(sketch->hitter_slots, 0,
+	       sketch->n_hitter_slots * sizeof(*sketch->hitter_slots));
+	for (hitter_i = 0; hitter_i < sketch->n_hitters; hitter_i++) {
+		uint64_t hash = sketch->hitters[hitter_i].hash;
+		size_t slot_i = find_hitter_slot(sketch, hash);
+
+		if (sketch->hitter_slots[slot_i] != 0) {
+			errno = EINVAL;
+			return -1;
+		}
+		sketch->hitter_slots[slot_i] = hitter_i + 1;
+	}
+	for (hitter_i = sketch->n_hitters / 2; hitter_i > 0; hitter_i--) {
+		sift_hitter_down(sketch, hitter_i - 1);
+	}
+	return 0;
+}
+
+/*
+ * Keep a string among the most frequent strings,
+ * if its count is high enough,
+ * replacing the least frequent string if there is no room.
+ * Since counts only grow, a string that is already kept
+ * never has a count lower than the least frequent kept string.
+ * sketch:	the sketch to which the string was added
+ * string:	the string
+ * length:	the length of the string
+ * hash:	the hash of the string
+ * count:	the estimated number of appearances of the string
+ */
+static void offer_hitter(struct string_sketch *sketch, const char *string,
+			 size_t length, uint64_t hash, uint64_t count)
+{
+	struct heavy_hitter *hitter;
+	size_t slot_i, hitter_i;
+
+	if (sketch->max_hitters == 0 ||
+	    (sketch->n_hitters == sketch->max_hitters &&
+	     count <= sketch->hitters[0].count)) {
+		return;
+	}
+
+	slot_i = find_hitter_slot(sketch, hash);
+	if (sketch->hitter_slots[slot_i] != 0) {
+		hitter_i = sketch->hitter_slots[slot_i] - 1;
+		sketch->hitters[hitter_i].count = count;
+		sift_hitter_down(sketch, hitter_i);
+		return;
+	}
+
+	if (sketch->n_hitters < sketch->max_hitters) {
+		hitter_i = sketch->n_hitters++;
+	} else {
+		/* Replace the least frequent string. */
+		hitter_i = 0;
+		remove_hitter_slot(sketch,
+				   find_hitter_slot(sketch,
+						    sketch->hitters[0].hash));
+		slot_i = find_hitter_slot(sketch, hash);
+	}
+	hitter = sketch->hitters + hitter_i;
+	hitter->hash = hash;
+	hitter->count = count;
+	hitter->length = length;
+	memcpy(hitter->string, string, length < MAX_HITTER_BYTES ?
+				       length : MAX_HITTER_BYTES);
+	sketch->hitter_slots[slot_i] = hitter_i + 1;
+
+	if (hitter_i == 0) {
+		sift_hitter_down(sketch, hitter_i);
+	} else {
+		sift_hitter_up(sketch, hitter_i);
+	}
+}
+
+void add_string_sketch(struct string_sketch *sketch, const char *string,
+		       size_t length, uint64_t hash)
+{
+	uint64_t count = estimate_count(sketch, hash) + 1;
+	unsigned row_i;
+
+	add_hyperloglog(&sketch->distinct, hash);
+	sketch->n_strings++;
+
+	/*
+	 * Only raise the counters below the new estimate,
+	 * which keeps the estimates of other strings lower.
+	 */
+	for (row_i = 0; row_i < sketch->depth; row_i++) {
+		uint64_t *counter = find_counter(sketch, hash, row_i);
+
+		if (*counter < count) {
+			*counter = count;
+		}
+	}
+
+	offer_hitter(sketch, string, length, hash, count);
+}
+
+int merge_string_sketch(struct string_sketch *into,
+			const struct string_sketch *from)
+{
+	size_t counter_i, hitter_i;
+
+	if (into->distinct.precision != from->distinct.precision ||
+	    into->depth != from->depth || into->width != from->width) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	merge_hyperloglog(&into->distinct, &from->distinct);
+	into->n_strings += from->n_strings;
+	for (counter_i = 0; counter_i < into->depth * into->width;
+	     counter_i++) {
+		into->counters[counter_i] += from->counters[counter_i];
+	}
+
+	/* Every count may have grown, so estimate them all again. */
+	for (hitter_i = 0; hitter_i < into->n_hitters; hitter_i++) {
+		into->hitters[hitter_i].count =
+			estimate_count(into, into->hitters[hitter_i].hash);
+	}
+	rebuild_hitters(into);
+	for (hitter_i = 0; hitter_i < from->n_hitters; hitter_i++) {
+		const struct heavy_hitter *hitter = from->hitters + hitter_i;
+
+		offer_hitter(into, hitter->string, hitter->length,
+			     hitter->hash, estimate_count(into, hitter->hash));
+	}
+
+	return 0;
+}
+
+/*
+ * Order strings from the most frequent, for "qsort".
+ * Strings that are equally frequent are ordered by hash,
+ * so that the order does not depend on the order of the additions.
+ * first:	the first string to compare
+ * second:	the second string to compare
+ * returns	negative if the first string comes first,
+ *		positive if it comes second,
+ *		and 0 if the strings are equal
+ */
+static int compare_hitters(const void *first, const void *second)
+{
+	const struct heavy_hitter *first_hitter = first;
+	const struct heavy_hitter *second_hitter = second;
+
+	if (first_hitter->count != second_hitter->count) {
+		return first_hitter->count > second_hitter->count ? -1 : 1;
+	}
+	return (first_hitter->hash > second_hitter->hash) -
+	       (first_hitter->hash < second_hitter->hash);
+}
+
+/* the marker after a frequent string that was too long to keep whole */
+#define CUT_MARKER	"[...]"
+
+void print_string_sketch(FILE *out, const struct string_sketch *sketch)
+{
+	struct heavy_hitter *sorted = malloc((sketch->n_hitters + 1) *
+					     sizeof(*sorted));
+	size_t hitter_i;
+
+	fprintf(out, "Strings:\t%llu\n",
+		(unsigned long long) sketch->n_strings);
+	fprintf(out, "Distinct strings:\t~%.0f\n",
+		estimate_hyperloglog(&sketch->distinct));
+
+	if (sorted != NULL) {
+		memcpy(sorted, sketch->hitters,
+		       sketch->n_hitters * sizeof(*sorted));
+		qsort(sorted, sketch->n_hitters, sizeof(*sorted),
+		      compare_hitters);
+	}
+	for (hitter_i = 0; hitter_i < sketch->n_hitters &&
+	     hitter_i < sketch->n_top; hitter_i++) {
+		/* Without memory to sort them, print them as they are. */
+		const struct heavy_hitter *hitter = (sorted != NULL ?
+						     sorted :
+						     sketch->hitters) +
+						    hitter_i;
+
+		fprintf(out, "~%llu\t", (unsigned long long) hitter->count);
+		if (hitter->length <= MAX_HITTER_BYTES) {
+			fwrite(hitter->string, 1, hitter->length, out);
+		} else {
+			fwrite(hitter->string, 1, MAX_HITTER_BYTES, out);
+			fprintf(out, CUT_MARKER);
+		}
+		fprintf(out, "\n");
+	}
+
+	free(sorted);
+}
+
+/* the bytes at the start of every saved sketch */
+#define SKETCH_MAGIC		"SFSKTCH1"
+#define SKETCH_MAGIC_LEN	(sizeof(SKETCH_MAGIC) - 1)
+
+int write_string_sketch(const struct string_sketch *sketch, FILE *out)
+{
+	size_t n_registers = (size_t) 1 << sketch->distinct.precision;
+	size_t counter_i, hitter_i;
+
+	if (fwrite(SKETCH_MAGIC, 1, SKETCH_MAGIC_LEN, out) !=
+	    SKETCH_MAGIC_LEN ||
+	    write_number(out, sketch->distinct.precision, sizeof(uint32_t)) ||
+	    write_number(out, sketch->depth, sizeof(uint32_t)) ||
+	    write_number(out, sketch->width, sizeof(uint64_t)) ||
+	    write_number(out, sketch->max_hitters, sizeof(uint64_t)) ||
+	    write_number(out, sketch->n_top, sizeof(uint64_t)) ||
+	    write_number(out, sketch->n_strings, sizeof(uint64_t)) ||
+	    fwrite(sketch->distinct.registers, 1, n_registers, out) !=
+	    n_registers) {
+		return -1;
+	}
+
+	for (counter_i = 0; counter_i < sketch->depth * sketch->width;
+	     counter_i++) {
+		if (write_number(out, sketch->counters[counter_i],
+				 sizeof(uint64_t))) {
+			return -1;
+		}
+	}
+
+	if (write_number(out, sketch->n_hitters, sizeof(uint64_t))) {
+		return -1;
+	}
+	for (hitter_i = 0; hitter_i < sketch->n_hitters; hitter_i++) {
+		const struct heavy_hitter *hitter = sketch->hitters + hitter_i;
+		size_t kept = hitter->length < MAX_HITTER_BYTES ?
+			      hitter->length : MAX_HITTER_BYTES;
+
+		if (write_number(out, hitter->hash, sizeof(uint64_t)) ||
+		    write_number(out, hitter->count, sizeof(uint64_t)) ||
+		    write_number(out, hitter->length, sizeof(uint64_t)) ||
+		    fwrite(hitter->string, 1, kept, out) != kept) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Read the contents of a sketch, after its dimensions.
+ * sketch:	the sketch, created with the saved dimensions
+ * in:		the input stream from which to read
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "fread",
+ *		   or to EINVAL if the input is not a sketch
+ */
+static int read_sketch_contents(struct string_sketch *sketch, FILE *in)
+{
+	size_t n_registers = (size_t) 1 << sketch->distinct.precision;
+	uint64_t n_hitters;
+	size_t register_i, counter_i, hitter_i;
+
+	if (read_number(in, &sketch->n_strings, sizeof(uint64_t)) ||
+	    fread(sketch->distinct.registers, 1, n_registers, in) !=
+	    n_registers) {
+		return -1;
+	}
+	for (register_i = 0; register_i < n_registers; register_i++) {
+		if (sketch->distinct.registers[register_i] >
+		    64 - sketch->distinct.precision + 1) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	for (counter_i = 0; counter_i < sketch->depth * sketch->width;
+	     counter_i++) {
+		if (read_number(in, sketch->counters + counter_i,
+				sizeof(uint64_t))) {
+			return -1;
+		}
+	}
+
+	if (read_number(in, &n_hitters, sizeof(uint64_t))) {
+		return -1;
+	}
+	if (n_hitters > sketch->max_hitters) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (hitter_i = 0; hitter_i < n_hitters; hitter_i++) {
+		struct heavy_hitter *hitter = sketch->hitters + hitter_i;
+		uint64_t length;
+		size_t kept;
+
+		if (read_number(in, &hitter->hash, sizeof(uint64_t)) ||
+		    read_number(in, &hitter->count, sizeof(uint64_t)) ||
+		    read_number(in, &length, sizeof(uint64_t))) {
+			return -1;
+		}
+		hitter->length = length;
+		kept = length < MAX_HITTER_BYTES ? length : MAX_HITTER_BYTES;
+		if (fread(hitter->string, 1, kept, in) != kept) {
+			return -1;
+		}
+	}
+	sketch->n_hitters = n_hitters;
+
+	return rebuild_hitters(sketch);
+}
+
+int read_string_sketch(struct string_sketch *sketch, FILE *in)
+{
+	char magic[SKETCH_MAGIC_LEN];
+	uint64_t precision, depth, width, max_hitters, n_top;
+
+	if (fread(magic, 1, SKETCH_MAGIC_LEN, in) != SKETCH_MAGIC_LEN ||
+	    memcmp(magic, SKETCH_MAGIC, SKETCH_MAGIC_LEN) != 0 ||
+	    read_number(in, &precision, sizeof(uint32_t)) ||
+	    read_number(in, &depth, sizeof(uint32_t)) ||
+	    read_number(in, &width, sizeof(uint64_t)) ||
+	    read_number(in, &max_hitters, sizeof(uint64_t)) ||
+	    read_number(in, &n_top, sizeof(uint64_t))) {
+		errno = EINVAL;
+		return -1;
+	}
+	/* Check the dimensions before trusting them with allocations. */
+	if (precision < MIN_HYPERLOGLOG_PRECISION ||
+	    precision > MAX_HYPERLOGLOG_PRECISION ||
+	    depth < 1 || depth > MAX_COUNT_MIN_DEPTH ||
+	    width < MIN_COUNT_MIN_WIDTH || width > MAX_COUNT_MIN_WIDTH ||
+	    (width & (width - 1)) != 0 || max_hitters > MAX_HITTERS ||
+	    n_top > max_hitters) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (init_sketch_dimensions(sketch, precision, depth, width,
+				   max_hitters, n_top)) {
+		return -1;
+	}
+	if (read_sketch_contents(sketch, in)) {
+		destroy_string_sketch(sketch);
+		return -1;
+	}
+	return 0;
+}
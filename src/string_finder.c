@@ -1,41 +1,219 @@
+#define _GNU_SOURCE
 #include <string_finder.h>
 
-#include <file_buffer.h>
+#include <scan_kernels.h>
+#include <inode_set.h>
+#include <baseline.h>
+#include <byte_hash.h>
+#include <shard.h>
+#include <literal_index.h>
+#include <sketch.h>
+#include <git_source.h>
+#include <engine.h>
+#include <probes.h>
 #include <logger.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <strings.h>
 #include <string.h>
 #include <errno.h>
 #include <dirent.h>
-#include <ctype.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define FILE_SEPARATOR	'/'
 
+/*
+ * the whole contents of an input file, held contiguously in memory,
+ * in memory that is reused for every file
+ */
+struct text_buffer {
+	char *data;		/* the bytes of the file */
+	size_t size;		/* the number of bytes in "data" */
+	size_t capacity;	/* the number of bytes allocated for "data" */
+};
+
+/* the state of a search, shared by every file that it visits */
+struct search {
+	/* the output stream to which to print */
+	FILE *out;
+	/* the settings chosen by the user */
+	const struct string_finder_options *options;
+	/* the contents of the current file, reused for every file */
+	struct text_buffer buffer;
+	/* the status of the current file, as found by the traversal */
+	const struct stat *file_stat;
+	/* the number of strings found in the current file, for the probes */
+	size_t n_found;
+	/* the thresholds choosing how each file is read and scanned */
+	struct engine_thresholds thresholds;
+	/* the kernels with which to scan the current file */
+	const struct scan_kernels *kernels;
+	/* the directories and files that have already been visited */
+	struct inode_set visited;
+	/* the device containing the root directory */
+	dev_t root_device;
+	/* the originally-specified path */
+	const char *root_path;
+	/*
+	 * the strings in each file, either being collected
+	 * to save as a new baseline, or loaded to compare against
+	 */
+	struct baseline baseline;
+	/* the strings in the current file, for the baseline */
+	struct string_tally tally;
+	/*
+	 * While comparing against a baseline,
+	 * the file in the baseline with the same path as the current file,
+	 * or NULL if there is none.
+	 */
+	struct baseline_file *old_file;
+	/* the number of files found by the traversal so far */
+	size_t n_files;
+	/*
+	 * Is the traversal only collecting the sizes of the files,
+	 * to balance the shards?
+	 */
+	int planning;
+	/* the assignment of files to shards, if balanced by size */
+	struct shard_plan plan;
+	/* the strings collected so far, to be written as an index */
+	struct index_builder index;
+	/* the approximate statistics about every string found */
+	struct string_sketch sketch;
+	/*
+	 * the estimates of the distinct strings in each directory
+	 * on the path to the current one, from the root,
+	 * each merged into its parent when the directory is left
+	 */
+	struct hyperloglog *directory_sketches;
+	/* the number of directories on the path to the current one */
+	size_t sketch_depth;
+	/* the number of estimates in "directory_sketches" */
+	size_t n_directory_sketches;
+};
+
 /*
  * Perform specified action on a regular file, and do not recurse.
- * out:		the output stream for the action
+ * The file is opened without setting up a stdio stream,
+ * since it is read whole into the search's buffer.
+ * search:	the state of the search, passed on to the action
  * path:	the path of the file on which to perform the action
+ * file_stat:	the status of the file
  * file_action:	the actions to perform on the file
  * returns:	0 on success,
  *		-1 on error,
- *		   with "errno" set by "fopen" if opening the file failed,
+ *		   with "errno" set by "open" if opening the file failed,
  *		   or by "file_action"
  */
-static int act_on_file(FILE *out, const char *path,
-		       int (*file_action)(FILE *out, FILE *in,
+static int act_on_file(struct search *search, const char *path,
+		       const struct stat *file_stat,
+		       int (*file_action)(struct search *search, int in,
 					  const char *path))
 {
-	FILE *entry_file = fopen(path, "r");
+	int entry_fd;
+	int error;
 
-	if (entry_file == NULL) {
+	PROBE1(file_open, path);
+	entry_fd = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+	PROBE2(file_opened, path, entry_fd);
+	if (entry_fd < 0) {
 		printlg(ERROR_LEVEL, "Failed to open file %s.\n", path);
 		return -1;
+	}
+
+	search->file_stat = file_stat;
+	error = file_action(search, entry_fd, path);
+	close(entry_fd);
+	return error;
+}
+
+static const char *relative_path(const struct search *search,
+				 const char *path);
+/*
+ * When comparing against a baseline,
+ * find a file's entry in the baseline, and mark it as visited,
+ * so that the file's strings are not reported as removed,
+ * even if the file is then skipped,
+ * as not text or as already searched through another path.
+ * search:	the state of the search, including the baseline,
+ *		which stores the entry, or NULL if there is none
+ * path:	the path of the file
+ */
+static void find_old_file(struct search *search, const char *path)
+{
+	if (search->options->diff_baseline_path == NULL) {
+		return;
+	}
+
+	search->old_file = find_baseline_file(&search->baseline,
+					      relative_path(search, path));
+	if (search->old_file != NULL) {
+		search->old_file->visited = 1;
+	}
+}
+
+/*
+ * Perform specified action on a file found by the traversal,
+ * if it belongs to this shard of the search.
+ * search:	the state of the search, passed on to the action
+ * path:	the path of the file
+ * file_stat:	the status of the file
+ * file_action:	the actions to perform on the file
+ * returns:	0 on success,
+ *		-1 on error,
+ *		   with errno set by "add_planned_file"
+ *		   if the file could not be added to the shard plan,
+ *		   or by "act_on_file"
+ */
+static int visit_file(struct search *search, const char *path,
+		      const struct stat *file_stat,
+		      int (*file_action)(struct search *search, int in,
+					 const char *path))
+{
+	const struct string_finder_options *options = search->options;
+	size_t ordinal = search->n_files++;
+	unsigned shard_index;
+
+	if (options->n_shards == 0) {
+		return act_on_file(search, path, file_stat, file_action);
+	}
+
+	if (search->planning) {
+		if (add_planned_file(&search->plan,
+				     relative_path(search, path),
+				     file_stat->st_size)) {
+			printlg(ERROR_LEVEL, "Failed to plan shard for %s.\n",
+				path);
+			return -1;
+		}
+		return 0;
+	}
+
+	if (options->balance_shards) {
+		shard_index = planned_shard_of_path(&search->plan,
+						    relative_path(search, path),
+						    options->n_shards);
 	} else {
-		int error = file_action(out, entry_file, path);
-		fclose(entry_file);
-		return error;
+		shard_index = shard_of_path(relative_path(search, path),
+					    options->n_shards);
+	}
+	if (shard_index != options->shard_index) {
+		return 0;
+	}
+
+	/*
+	 * Let the outputs of the shards be merged in traversal order.
+	 * Sketches are merged as a whole instead.
+	 */
+	if (!options->sketch) {
+		print_shard_record(search->out, ordinal);
 	}
+	return act_on_file(search, path, file_stat, file_action);
 }
 
 /*
@@ -44,54 +222,303 @@ static int act_on_file(FILE *out, const char *path,
  * and should be skipped.
  */
 #define LOOP_DIR_CHAR '.'
+/*
+ * the precision of the estimate of the distinct strings in each directory,
+ * which is lower than for the whole search,
+ * since there is one for each directory on the current path
+ */
+#define DIRECTORY_SKETCH_PRECISION	10
+/*
+ * Start estimating the distinct strings in a directory being entered,
+ * reusing the estimate of a directory left earlier at the same depth.
+ * search:	the state of the search, including the estimates
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "realloc" or "calloc"
+ */
+static int push_directory_sketch(struct search *search)
+{
+	if (search->sketch_depth == search->n_directory_sketches) {
+		struct hyperloglog *new_sketches =
+			realloc(search->directory_sketches,
+				(search->n_directory_sketches + 1) *
+				sizeof(*new_sketches));
+
+		if (new_sketches == NULL) {
+			return -1;
+		}
+		search->directory_sketches = new_sketches;
+		if (init_hyperloglog(new_sketches +
+				     search->n_directory_sketches,
+				     DIRECTORY_SKETCH_PRECISION)) {
+			return -1;
+		}
+		search->n_directory_sketches++;
+	} else {
+		clear_hyperloglog(search->directory_sketches +
+				  search->sketch_depth);
+	}
+
+	search->sketch_depth++;
+	return 0;
+}
+
+/*
+ * Print the estimated number of distinct strings in a directory
+ * being left, as "[directory]:\t~[number]",
+ * and add them to the estimate for its parent.
+ * search:	the state of the search, including the estimates
+ * path:	the path of the directory
+ */
+static void pop_directory_sketch(struct search *search, const char *path)
+{
+	const struct hyperloglog *directory_sketch =
+		search->directory_sketches + --search->sketch_depth;
+
+	fprintf(search->out, "%s:\t~%.0f\n", path,
+		estimate_hyperloglog(directory_sketch));
+	if (search->sketch_depth > 0) {
+		merge_hyperloglog(search->directory_sketches +
+				  search->sketch_depth - 1, directory_sketch);
+	}
+}
+
+/*
+ * the entries of a directory, either read one at a time
+ * in the order in which the file system lists them,
+ * or all read at once, and sorted by name
+ */
+struct dir_listing {
+	/* the directory */
+	DIR *dir;
+	/* Are the entries sorted by name? */
+	int sorted;
+	/* the sorted names of the entries, if they are sorted */
+	char **names;
+	/* the number of names in "names" */
+	size_t n_names;
+	/* the index in "names" of the next entry */
+	size_t next_name;
+};
+
+/*
+ * Compare the names of two directory entries, byte by byte,
+ * so that the order does not depend on the locale.
+ * first:	the first name, as a "char *const *"
+ * second:	the second name, as a "char *const *"
+ * returns	a negative number if the first name comes first,
+ *		a positive number if the second one does, 0 if they are equal
+ */
+static int compare_entry_names(const void *first, const void *second)
+{
+	return strcmp(*(char *const *) first, *(char *const *) second);
+}
+
+/*
+ * Free the names of the entries of a directory.
+ * listing:	the entries whose names to free
+ */
+static void destroy_dir_listing(struct dir_listing *listing)
+{
+	size_t name_i;
+
+	for (name_i = 0; name_i < listing->n_names; name_i++) {
+		free(listing->names[name_i]);
+	}
+	free(listing->names);
+}
+
+/*
+ * Start listing the entries of a directory.
+ * When the search is split into shards,
+ * the entries are sorted by name,
+ * so that the files have the same positions in the traversal
+ * in every copy of the same files, on any machine or file system,
+ * whatever order each file system lists them in,
+ * and the outputs of shards searching different copies can be merged.
+ * listing:	the listing to initialize,
+ *		which must later be freed with "destroy_dir_listing"
+ * dir:		the directory
+ * sort:	Sort the entries by name?
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "realloc" or "strdup"
+ */
+static int init_dir_listing(struct dir_listing *listing, DIR *dir, int sort)
+{
+	struct dirent *entry;
+	size_t capacity = 0;
+
+	memset(listing, 0, sizeof(*listing));
+	listing->dir = dir;
+	listing->sorted = sort;
+	if (!sort) {
+		return 0;
+	}
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (listing->n_names == capacity) {
+			size_t new_capacity = capacity == 0 ? 16 :
+					      capacity * 2;
+			char **new_names = realloc(listing->names,
+						   new_capacity *
+						   sizeof(*new_names));
+
+			if (new_names == NULL) {
+				destroy_dir_listing(listing);
+				return -1;
+			}
+			listing->names = new_names;
+			capacity = new_capacity;
+		}
+		if ((listing->names[listing->n_names] =
+		     strdup(entry->d_name)) == NULL) {
+			destroy_dir_listing(listing);
+			return -1;
+		}
+		listing->n_names++;
+	}
+
+	if (listing->n_names > 1) {
+		qsort(listing->names, listing->n_names,
+		      sizeof(*listing->names), compare_entry_names);
+	}
+	return 0;
+}
+
+/*
+ * Get the name of the next entry of a directory.
+ * listing:	the entries of the directory
+ * returns	the name, which is valid until the next call
+ *		for an unsorted listing,
+ *		or NULL once every entry has been listed
+ */
+static const char *next_dir_entry(struct dir_listing *listing)
+{
+	struct dirent *entry;
+
+	if (listing->sorted) {
+		return listing->next_name < listing->n_names ?
+		       listing->names[listing->next_name++] : NULL;
+	}
+	entry = readdir(listing->dir);
+	return entry == NULL ? NULL : entry->d_name;
+}
+
 /*
  * Given a real directory, recursively (ie. depth first)
  * perform specified action on files contained in directory.
- * out:			the output stream for the action
+ * Each directory and file is only visited once,
+ * even if it can be reached through several paths,
+ * so symbolic link loops and bind mounts are not searched repeatedly.
+ * When the search is split into shards, the entries are sorted by name.
+ * While sketching, the estimated number of distinct strings
+ * in each directory is printed once it has been searched.
+ * search:		the state of the search, passed on to the action
  * current_path:	the path of the current directory
  * file_action:		the actions to perform on a normal file
  * current_dir:		the current directory
  * returns		0 on success,
  *			-1 on error, with errno set
- *			   by "opendir" if opening a subdirectory failed,
- *			   or by "act_on_file"
+ *			   by "stat" or "opendir" if opening a subdirectory
+ *			   failed,
+ *			   by "add_inode" if the entry could not be recorded,
+ *			   by "init_dir_listing" if the entries could not
+ *			   be sorted,
+ *			   by "push_directory_sketch" if the estimate
+ *			   for the directory could not be created,
+ *			   or by "visit_file"
  */
-static int _traverse_dir(FILE *out, const char *current_path,
-			 int (*file_action)(FILE *out, FILE *in,
+static int _traverse_dir(struct search *search, const char *current_path,
+			 int (*file_action)(struct search *search, int in,
 					    const char *path),
 			 DIR *current_dir)
 {
+	const struct string_finder_options *options = search->options;
 	size_t current_path_len = strlen(current_path);
 	char full_path[current_path_len + 1 + NAME_MAX + 1];
 	char *next_segment_start = full_path + current_path_len + 1;
-	struct dirent *entry;
+	struct dir_listing listing;
+	const char *name;
+	int sketching = options->sketch && !search->planning;
 	int error = 0;
 
+	if (init_dir_listing(&listing, current_dir, options->n_shards > 0)) {
+		printlg(ERROR_LEVEL, "Failed to sort entries of %s.\n",
+			current_path);
+		return -1;
+	}
+	if (sketching && push_directory_sketch(search)) {
+		printlg(ERROR_LEVEL, "Failed to create sketch for %s.\n",
+			current_path);
+		destroy_dir_listing(&listing);
+		return -1;
+	}
+
+	/* Every "dir_enter" from here on is matched by a "dir_leave". */
+	PROBE1(dir_enter, current_path);
+
 	memcpy(full_path, current_path, current_path_len);
 	full_path[current_path_len] = FILE_SEPARATOR;
 
-	while (!error && (entry = readdir(current_dir)) != NULL) {
+	while (!error && (name = next_dir_entry(&listing)) != NULL) {
+		struct stat entry_stat;
 		DIR *subdir;
+		int added;
 
-		if (entry->d_name[0] == LOOP_DIR_CHAR) {
+		if (name[0] == LOOP_DIR_CHAR) {
 			continue;
 		}
 
-		strncpy(next_segment_start, entry->d_name,
-			NAME_MAX + 1);
-		subdir = opendir(full_path);
-		if (subdir == NULL) {
-			if (errno == ENOTDIR) {
-				error = act_on_file(out, full_path,
-						    file_action);
-			} else {
+		strncpy(next_segment_start, name, NAME_MAX + 1);
+		if (lstat(full_path, &entry_stat)) {
+			printlg(ERROR_LEVEL, "Failed to get status of %s.\n",
+				full_path);
+			error = -1;
+			break;
+		}
+		if (S_ISLNK(entry_stat.st_mode)) {
+			if (!options->follow_symlinks) {
+				continue;
+			}
+			if (stat(full_path, &entry_stat)) {
 				printlg(ERROR_LEVEL,
-					"Failed to open sub directory %s.\n",
+					"Failed to follow link %s.\n",
 					full_path);
 				error = -1;
+				break;
+			}
+		}
+
+		if (options->one_file_system &&
+		    entry_stat.st_dev != search->root_device) {
+			continue;
+		}
+
+		added = add_inode(&search->visited, entry_stat.st_dev,
+				  entry_stat.st_ino);
+		if (added < 0) {
+			printlg(ERROR_LEVEL, "Failed to record visit to %s.\n",
+				full_path);
+			error = -1;
+			break;
+		}
+		if (!added) {
+			/* already searched through another path */
+			if (!S_ISDIR(entry_stat.st_mode)) {
+				find_old_file(search, full_path);
 			}
+			continue;
+		}
+
+		if (!S_ISDIR(entry_stat.st_mode)) {
+			error = visit_file(search, full_path, &entry_stat,
+					   file_action);
+		} else if ((subdir = opendir(full_path)) == NULL) {
+			printlg(ERROR_LEVEL,
+				"Failed to open sub directory %s.\n",
+				full_path);
+			error = -1;
 		} else {
-			error = _traverse_dir(out, full_path,
+			error = _traverse_dir(search, full_path,
 					      file_action,
 					      subdir);
 
@@ -105,282 +532,1143 @@ static int _traverse_dir(FILE *out, const char *current_path,
 		}
 	}
 
+	if (sketching && !error) {
+		pop_directory_sketch(search, current_path);
+	} else if (sketching) {
+		search->sketch_depth--;
+	}
+	destroy_dir_listing(&listing);
+
+	PROBE2(dir_leave, current_path, error);
 	return error;
 }
 
 /*
  * General entry point for performing specified actions on
  * files rooted at a given path, which may be a file, or a directory.
- * out:			the output stream for the action
+ * search:		the state of the search, passed on to the action
  * root_path:		the originally-specified path
  * file_action:		the actions to perform on a normal file
  * returns		0 on success,
  *			-1 on error, with errno set
- *			   by "opendir" if opening a subdirectory failed,
- *			   or by "act_on_file"
+ *			   by "stat" or "opendir" if opening a directory
+ *			   failed,
+ *			   by "init_inode_set" if the set of visited
+ *			   files could not be created,
+ *			   or by "_traverse_dir" or "visit_file"
  */
-static int traverse_dir(FILE *out, const char *root_path,
-			int (*file_action)(FILE *out, FILE *in,
+static int traverse_dir(struct search *search, const char *root_path,
+			int (*file_action)(struct search *search, int in,
 					   const char *path))
 {
-	DIR *root_dir = opendir(root_path);
+	struct stat root_stat;
+	DIR *root_dir;
 	int ret;
 
-	if (root_dir == NULL) {
-		if (errno == ENOTDIR) {
-			return act_on_file(out, root_path, file_action);
-		}
+	if (stat(root_path, &root_stat)) {
+		printlg(ERROR_LEVEL, "Failed to get status of root, %s.\n",
+			root_path);
+		return -1;
+	}
+	if (!S_ISDIR(root_stat.st_mode)) {
+		return visit_file(search, root_path, &root_stat, file_action);
+	}
 
+	root_dir = opendir(root_path);
+	if (root_dir == NULL) {
 		printlg(ERROR_LEVEL, "Failed to open root directory, %s.\n",
 			root_path);
 		return -1;
 	}
 
-	ret = _traverse_dir(out, root_path, file_action, root_dir);
+	if (init_inode_set(&search->visited)) {
+		printlg(ERROR_LEVEL, "Failed to create set of visited files.\n");
+		closedir(root_dir);
+		return -1;
+	}
+	search->root_device = root_stat.st_dev;
+
+	ret = add_inode(&search->visited, root_stat.st_dev, root_stat.st_ino);
+	if (ret >= 0) {
+		ret = _traverse_dir(search, root_path, file_action, root_dir);
+	}
 
+	destroy_inode_set(&search->visited);
 	closedir(root_dir);
 	return ret;
 }
 
-/* marker for the beginning and end of a string */
-#define STRING_MARKER	'\"'
-/* marker for the beginning and end of a character */
-#define CHAR_MARKER	'\''
+/* the number of bytes to read at first if the file size is unknown */
+#define READ_CHUNK_SIZE	4096
 /*
- * When inside a string,
- * this character indicates that any special meaning of the next character
- * should be ignored. 
- * A real newline is not part of the string,
- * and therefore is not affected by an escape.
+ * Make room in a buffer for at least a given number of bytes,
+ * keeping its contents.
+ * The buffer at least doubles in size, so it is rarely grown.
+ * buffer:	the buffer to grow
+ * capacity:	the number of bytes needed
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "realloc",
+ *		   in which case the buffer is unchanged
  */
-#define ESCAPE_MARKER	'\\'
-/* character marking the end of a line */
-#define LINE_BREAK	'\n'
+static int grow_text_buffer(struct text_buffer *buffer, size_t capacity)
+{
+	char *grown;
+
+	if (capacity < buffer->capacity * 2) {
+		capacity = buffer->capacity * 2;
+	}
+	if ((grown = realloc(buffer->data, capacity)) == NULL) {
+		return -1;
+	}
+	buffer->data = grown;
+	buffer->capacity = capacity;
+	return 0;
+}
 
-/* states while reading a line */
-enum string_state {
-	NO_STRING, /* Cursor is not pointing inside a string yet. */
+/*
+ * Read an entire file into memory,
+ * so that it can be searched by the vectorized kernels.
+ * The buffer is reused from the previous file,
+ * and only grown if the file does not fit,
+ * so most files are read without allocating,
+ * and with a single call to "read".
+ * buffer:	the buffer to fill, which must later be freed with
+ *		"destroy_text_buffer"
+ * in:		the file descriptor from which to read
+ * in_stat:	the status of the file
+ * returns	0 on success,
+ *		-1 on failure, with errno set by
+ *		   "realloc" if the buffer could not be grown,
+ *		   or by "read" if reading failed
+ */
+static int fill_text_buffer(struct text_buffer *buffer, int in,
+			    const struct stat *in_stat)
+{
 	/*
-	 * Pointer is treating characters in the normal fashion:
-	 * a quotation mark indicates the end of the string;
-	 * a backslash indicates that the next character's special meaning
-	 * will be ignored.
+	 * A short read only means the end of a regular file
+	 * whose size is known, unlike many files in "/proc".
 	 */
-	NORMAL_CHAR,
-	/* Ignore any special meaning of the next character that is read. */
-	ESCAPED_CHAR
-};
+	int regular = S_ISREG(in_stat->st_mode) && in_stat->st_size > 0;
+	size_t needed = READ_CHUNK_SIZE;
+
+	if (regular) {
+		/* Leave room to notice that the file grew since its status. */
+		needed = (size_t) in_stat->st_size + 1;
+	}
+
+	buffer->size = 0;
+	for (;;) {
+		ssize_t n_read;
+
+		if (buffer->capacity < needed &&
+		    grow_text_buffer(buffer, needed)) {
+			return -1;
+		}
+
+		n_read = read(in, buffer->data + buffer->size,
+			      buffer->capacity - buffer->size);
+		if (n_read < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		buffer->size += n_read;
+
+		if (n_read == 0 ||
+		    (regular && buffer->size < buffer->capacity)) {
+			return 0;
+		}
+		needed = buffer->size + 1;
+	}
+}
 
 /*
- * Print the location of a line in a file,
- * ie. the file name and the line number, starting from 1.
- * out:		the output stream to which to print the message.
- * file_name:	the name of the file containing the line
- * line_number:	the line number to print
+ * Free the memory used by a buffer.
+ * buffer:	the buffer to free
  */
-static void print_line_location(FILE *out,
-				const char *file_name, size_t line_number)
+static void destroy_text_buffer(struct text_buffer *buffer)
 {
-	fprintf(out, "%s (%u):\t", file_name, (unsigned) line_number);
+	free(buffer->data);
 }
 
 /*
- * Check if the file contains non-text characters,
- * which will not print properly on terminal,
- * and rewind the buffer.
- * buffer:	the file buffer to check for non-text characters
- * returns	0 iff all characters are printable or whitespace in ASCII,
- *		1 otherwise
+ * the file currently mapped by "map_text_buffer", for "handle_sigbus",
+ * or NULL if there is none.
+ * Only one file is mapped at a time, by one search at a time.
+ */
+static char *volatile mapped_data;
+/* the number of bytes mapped at "mapped_data" */
+static volatile size_t mapped_size;
+/* Was the mapped file truncated while it was mapped? */
+static volatile sig_atomic_t mapped_truncated;
+/* the handler of SIGBUS before the file was mapped */
+static struct sigaction previous_sigbus;
+/* the size of a page of memory, to which mappings are aligned */
+static size_t page_size;
+
+/*
+ * Handle SIGBUS, raised by reading a mapped file past its end,
+ * after the file was truncated while it was mapped,
+ * as when a log is rotated.
+ * The pages past the end are replaced by pages of zeros,
+ * so that the search continues as though the file still held zeros,
+ * and the truncation is noticed once the file is unmapped.
+ * Any other SIGBUS is left to the previous handler,
+ * so that it is as fatal as without this handler.
+ * signal:	the signal, SIGBUS
+ * info:	the cause of the signal, including the faulting address
+ * context:	the interrupted context, which is not used
  */
-static int has_non_text(file_buffer_t *buffer)
+static void handle_sigbus(int signal, siginfo_t *info, void *context)
 {
-	size_t file_size = get_file_size(buffer);
-	long position;
+	char *fault = info->si_addr;
+	char *start = mapped_data;
+	int saved_errno = errno;
 
-	while ((position = ftell_buffer(buffer)) < (long) file_size) {
-		int byte_value = fgetc_buffer(buffer);
+	(void) signal;
+	(void) context;
 
-		if (!(isprint(byte_value) || isspace(byte_value))) {
-			return 1;
+	if (start != NULL && fault >= start && fault < start + mapped_size) {
+		char *page = start + (size_t) (fault - start) /
+				     page_size * page_size;
+
+		if (mmap(page, start + mapped_size - page, PROT_READ,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+			 -1, 0) != MAP_FAILED) {
+			mapped_truncated = 1;
+			errno = saved_errno;
+			return;
 		}
 	}
 
-	rewind_buffer(buffer);
-	return 0;
+	/* Returning faults again, this time into the previous handler. */
+	sigaction(SIGBUS, &previous_sigbus, NULL);
+	errno = saved_errno;
 }
 
 /*
- * Perform action on file, which is converted into a buffer,
- * only if all the characters are text characters.
- * out:			the output stream to which to print,
- *			and the first argument for "action"
- * in:			the file input stream to convert to
- *			a buffer from which to read
- *			as the second argument to "action"
- * in_file_name:	the name of the file from which to read,
- *			and the third and final argument to "action"
- * action:		the buffer-reading action to perform
- * returns		0 on success or the file contains non-text characters,
- *			-1 on failure, with errno set by
- *			   "init_file_buffer" if initializing the input buffer
- *			   failed,
- *			   or by "action"
+ * Map an entire regular file into memory, rather than copying it,
+ * which is faster for large enough files.
+ * If the file shrinks while it is mapped,
+ * reading past its new end reads zeros instead of raising SIGBUS,
+ * which "unmap_text_buffer" reports.
+ * buffer:	stores the mapping, which must later be freed with
+ *		"unmap_text_buffer"
+ * in:		the file descriptor of the file
+ * in_stat:	the status of the file, giving its size,
+ *		which must not be 0
+ * returns	0 on success,
+ *		-1 on failure, with errno set by "mmap" or "sigaction"
  */
-static int do_text_buffer_action(FILE *out, FILE *in, const char *in_file_name,
-				 int (*action)(FILE *out, file_buffer_t *buffer,
-					       const char *in_file_name))
+static int map_text_buffer(struct text_buffer *buffer, int in,
+			   const struct stat *in_stat)
 {
-	file_buffer_t buffer;
+	struct sigaction sigbus_action;
+	void *data = mmap(NULL, in_stat->st_size, PROT_READ, MAP_PRIVATE,
+			  in, 0);
 	int error;
 
-	if (init_file_buffer(&buffer, in)) {
-		printlg(ERROR_LEVEL, "Failed to generate buffer.\n");
+	if (data == MAP_FAILED) {
 		return -1;
 	}
 
-	if (has_non_text(&buffer)) {
-		error = 0;
-	} else {
-		error = action(out, &buffer, in_file_name);
+	if (page_size == 0) {
+		page_size = sysconf(_SC_PAGESIZE);
 	}
+	mapped_data = data;
+	mapped_size = in_stat->st_size;
+	mapped_truncated = 0;
 
+	memset(&sigbus_action, 0, sizeof(sigbus_action));
+	sigbus_action.sa_sigaction = handle_sigbus;
+	sigbus_action.sa_flags = SA_SIGINFO;
+	sigemptyset(&sigbus_action.sa_mask);
+	if (sigaction(SIGBUS, &sigbus_action, &previous_sigbus)) {
+		error = errno;
+		mapped_data = NULL;
+		munmap(data, in_stat->st_size);
+		errno = error;
+		return -1;
+	}
 
-	destroy_file_buffer(&buffer);
-	return error;
+	buffer->data = data;
+	buffer->size = in_stat->st_size;
+	buffer->capacity = in_stat->st_size;
+	return 0;
 }
 
 /*
- * the template for the warning to print if
- * a line was completed without finding the end of a string.
- * Arguments are file name (char *) and line number (unsigned).
+ * Unmap a file mapped by "map_text_buffer".
+ * buffer:	the mapping to free
+ * returns	1 if the file was truncated while it was mapped,
+ *		so that zeros were read in place of its missing end,
+ *		0 otherwise
  */
-#define INCOMPLETE_WARNING	"File %s, line %u " \
-				"might not contain a real, complete string.\n"
+static int unmap_text_buffer(struct text_buffer *buffer)
+{
+	int truncated = mapped_truncated;
+
+	sigaction(SIGBUS, &previous_sigbus, NULL);
+	mapped_data = NULL;
+	munmap(buffer->data, buffer->capacity);
+	return truncated;
+}
 
 /*
- * Given a buffer to a file only containing text characters,
- * find and print the separate strings.
- * out:			the output stream to which to print
- * buffer:		the file input buffer in which to search for strings
- * in_file_name:	the name of the file from which to read
+ * Perform specified action on the files of a git revision,
+ * or only on the files added or changed since a base revision,
+ * read from the repository's object store rather than the working tree,
+ * so that the revision does not need to be checked out,
+ * and the time taken depends on the size of the change.
+ * Each file is named by its path in the repository.
+ * search:		the state of the search,
+ *			including the path of the repository
+ * file_action:		the actions to perform on each file, which is
+ *			already in the search's buffer, so that the action
+ *			is given -1 instead of a file descriptor
  * returns		0 on success,
- *			-1 on failure, with errno set by
- *			   "fgetc_buffer" if the file unexpectedly ended
+ *			-1 on error, with errno set by "open_git_source",
+ *			   "next_git_blob", "grow_text_buffer",
+ *			   "read_git_blob" or "close_git_source",
+ *			   or by "file_action"
  */
-static int
-_find_strings_action(FILE *out, file_buffer_t *buffer, const char *in_file_name)
+static int traverse_git(struct search *search,
+			int (*file_action)(struct search *search, int in,
+					   const char *path))
 {
-	size_t file_size = get_file_size(buffer);
-	size_t line_number = 1;
-	enum string_state state = NO_STRING;
+	const struct string_finder_options *options = search->options;
+	struct text_buffer *buffer = &search->buffer;
+	struct git_source source;
+	const char *path;
+	size_t size;
+	int found;
 	int error = 0;
-	char marker_char;
 
-	while (ftell_buffer(buffer) < (long) file_size) {
-		int current_input = fgetc_buffer(buffer);
-		unsigned char current_char;
-		int need_to_print, end_line;
+	if (open_git_source(&source, search->root_path,
+			    options->git_base_rev, options->git_rev)) {
+		printlg(ERROR_LEVEL, "Failed to run git in %s.\n",
+			search->root_path);
+		return -1;
+	}
 
-		if (current_input == EOF) {
-			printlg(ERROR_LEVEL,
-				"Unexpectedly reached end of file %s "
-				"while searching for strings.\n",
-				in_file_name);
+	search->file_stat = NULL;
+	while (!error && (found = next_git_blob(&source, &path, &size)) > 0) {
+		PROBE1(read_start, path);
+		if (buffer->capacity <= size &&
+		    grow_text_buffer(buffer, size + 1)) {
+			printlg(ERROR_LEVEL, "Failed to generate buffer.\n");
 			error = -1;
 			break;
 		}
-
-		current_char = (char) current_input;
-
-		/*
-		 * If we reached the end of the line, always start a new line,
-		 * and reset the string state.
-		 */
-		if (current_char == LINE_BREAK) {
-			if (state != NO_STRING) {
-				printlg(WARNING_LEVEL, INCOMPLETE_WARNING,
-					in_file_name, (unsigned) line_number);
-				fprintf(out, "\n");
-				state = NO_STRING;
-			}
-			line_number++;
-		}
-
-		need_to_print = 0;
-		end_line = 0;
-		/*
-		 * If we are not in a string, and read a quotation mark,
-		 * we have entered the string,
-		 * and need to print location of the line,
-		 * and the opening quotation mark.
-		 */
-		if (state == NO_STRING) {
-			if (current_char == STRING_MARKER ||
-			    current_char == CHAR_MARKER) {
-				print_line_location(out,
-						    in_file_name, line_number);
-				state = NORMAL_CHAR;
-				marker_char = current_char;
-				need_to_print = 1;
-			}
-		} else {
-			/*
-			 * If we are inside a string,
-			 * every character needs to be printed,
-			 * including escape characters
-			 * and the closing quotation mark.
-			 */
-			if (state == ESCAPED_CHAR) {
-				/*
-				 * Ignore any special meaning of a character
-				 * following the escape character,
-				 * and exit the escaping state.
-				 */
-				state = NORMAL_CHAR;
-			} else if (current_char == marker_char) {
-				/* Close the string, and end this line. */
-				state = NO_STRING;
-				end_line = 1;
-			} else if (current_char == ESCAPE_MARKER) {
-				/* Ignore the meaning of the next character. */
-				state = ESCAPED_CHAR;
-			}
-			need_to_print = 1;
-		}
-		if (need_to_print) {
-			fprintf(out, "%c", current_char);
-		}
-		if (end_line) {
-			debug_assert(need_to_print);
-			fprintf(out, "\n");
+		error = read_git_blob(&source, buffer->data, size);
+		buffer->size = size;
+		PROBE2(read_done, path, size);
+		if (error) {
+			printlg(ERROR_LEVEL, "Failed to read %s from git.\n",
+				path);
+			break;
 		}
+		error = file_action(search, -1, path);
 	}
-	fprintf(out, "\n");
+	if (found < 0) {
+		printlg(ERROR_LEVEL, "Failed to list files in git.\n");
+		error = -1;
+	}
+
+	/* A failure above is often caused by git failing. */
+	if (close_git_source(&source)) {
+		printlg(ERROR_LEVEL, "git failed in %s.\n", search->root_path);
+		error = -1;
+	}
+	return error;
+}
+
+/*
+ * Perform specified action on every file being searched,
+ * either on disk or in a git revision.
+ * search:		the state of the search, including the searched path
+ * file_action:		the actions to perform on each file
+ * returns		0 on success,
+ *			-1 on error, with errno set by "traverse_git"
+ *			   or "traverse_dir"
+ */
+static int traverse_files(struct search *search,
+			  int (*file_action)(struct search *search, int in,
+					     const char *path))
+{
+	if (search->options->git_rev != NULL) {
+		return traverse_git(search, file_action);
+	}
+	return traverse_dir(search, search->root_path, file_action);
+}
+
+/* marker for the beginning and end of a string */
+#define STRING_MARKER	'\"'
+/* marker for the beginning and end of a character */
+#define CHAR_MARKER	'\''
+/*
+ * When inside a string,
+ * this character indicates that any special meaning of the next character
+ * should be ignored. 
+ * A real newline is not part of the string,
+ * and therefore is not affected by an escape.
+ */
+#define ESCAPE_MARKER	'\\'
+/* character marking the end of a line */
+#define LINE_BREAK	'\n'
+
+/* ways in which the search for the end of a string can stop */
+enum string_end {
+	/* An unescaped copy of the opening quotation mark was found. */
+	CLOSED_STRING,
+	/* The line ended before the string was closed. */
+	BROKEN_STRING,
+	/* The file ended before the string was closed. */
+	TRUNCATED_STRING
+};
+
+/*
+ * Find the end of the string starting at a quotation mark:
+ * a matching quotation mark that does not follow an escape character
+ * closes the string;
+ * a line break or the end of the file ends it incompletely.
+ * opening:	the opening quotation mark
+ * end:		the end of the file
+ * how:		stores how the string ended
+ * returns	the position after the closing quotation mark,
+ *		or the position of the line break or end of file
+ *		that ended the string early
+ */
+static const char *skip_string(const char *opening, const char *end,
+			       enum string_end *how)
+{
+	char marker_char = *opening;
+	const char *cursor = opening + 1;
+
+	while (cursor < end) {
+		char current_char = *cursor;
+
+		if (current_char == LINE_BREAK) {
+			*how = BROKEN_STRING;
+			return cursor;
+		}
+
+		cursor++;
+		if (current_char == marker_char) {
+			*how = CLOSED_STRING;
+			return cursor;
+		}
+		/*
+		 * Ignore any special meaning of a character
+		 * following the escape character,
+		 * unless it is a real line break.
+		 */
+		if (current_char == ESCAPE_MARKER && cursor < end &&
+		    *cursor != LINE_BREAK) {
+			cursor++;
+		}
+	}
+
+	*how = TRUNCATED_STRING;
+	return end;
+}
+
+/*
+ * Print the location of a line in a file,
+ * ie. the file name and the line number, starting from 1.
+ * out:		the output stream to which to print the message.
+ * file_name:	the name of the file containing the line
+ * line_number:	the line number to print
+ */
+static void print_line_location(FILE *out,
+				const char *file_name, size_t line_number)
+{
+	fprintf(out, "%s (%u):\t", file_name, (unsigned) line_number);
+}
+
+/*
+ * Check if the file contains non-text characters,
+ * which will not print properly on terminal.
+ * buffer:	the file buffer to check for non-text characters
+ * kernels:	the kernels with which to check
+ * encoding:	the encoding in which the file should be text
+ * returns	0 iff all characters are printable or whitespace
+ *		in the encoding,
+ *		1 otherwise
+ */
+static int has_non_text(const struct text_buffer *buffer,
+			const struct scan_kernels *kernels,
+			enum text_encoding encoding)
+{
+	const char *end = buffer->data + buffer->size;
+
+	switch (encoding) {
+	case UTF8_ENCODING:
+		return !kernels->is_utf8_text(buffer->data, end);
+	case ASCII_ENCODING:
+	default:
+		return !kernels->is_ascii_text(buffer->data, end);
+	}
+}
+
+/*
+ * Find the path of a file relative to the searched directory,
+ * so that searches of copies of the directory can be compared.
+ * If a single file was searched, its path is its name.
+ * The path of a file in a git revision is already relative.
+ * search:	the state of the search, including the searched path
+ * path:	the path of the file, as built by the traversal
+ * returns	the relative path, which is part of "path"
+ */
+static const char *relative_path(const struct search *search,
+				 const char *path)
+{
+	size_t root_path_len = strlen(search->root_path);
+	const char *name;
+
+	if (search->options->git_rev != NULL) {
+		return path;
+	}
+	if (strncmp(path, search->root_path, root_path_len) == 0 &&
+	    path[root_path_len] == FILE_SEPARATOR) {
+		return path + root_path_len + 1;
+	}
+
+	name = strrchr(path, FILE_SEPARATOR);
+	return name == NULL ? path : name + 1;
+}
+
+/*
+ * When comparing against a baseline,
+ * find the file's entry in the baseline,
+ * and check if the file's contents are the same as when it was saved,
+ * in which case it does not need to be searched again.
+ * search:		the state of the search, including the baseline
+ * buffer:		the contents of the file
+ * in_file_name:	the name of the file
+ * returns		1 if the file is unchanged since the baseline,
+ *			0 otherwise, or if there is no baseline
+ */
+static int is_unchanged(struct search *search,
+			const struct text_buffer *buffer,
+			const char *in_file_name)
+{
+	if (search->options->diff_baseline_path == NULL) {
+		return 0;
+	}
+
+	find_old_file(search, in_file_name);
+	return search->old_file != NULL &&
+	       search->old_file->content_hash ==
+	       hash_bytes(buffer->data, buffer->size);
+}
+
+/*
+ * Choose whether to map a file into memory rather than copying it,
+ * by its size, unless the user forced a choice.
+ * Only regular files whose size is known can be mapped.
+ * A file whose size has changed since the traversal found it,
+ * as when it is being written or rotated, is copied instead,
+ * since a file that is shrinking would be read with zeros
+ * in place of its missing end,
+ * and mapping a file that is growing would miss its end.
+ * search:	the state of the search, including the thresholds
+ *		and the status of the file
+ * in:		the file descriptor of the file
+ * in_stat:	stores the current status of the file, if it is mapped
+ * returns	1 if the file should be mapped with "mmap",
+ *		0 if it should be copied with "read"
+ */
+static int should_map_file(const struct search *search, int in,
+			   struct stat *in_stat)
+{
+	const struct stat *file_stat = search->file_stat;
+	int map;
+
+	if (!S_ISREG(file_stat->st_mode) || file_stat->st_size <= 0) {
+		return 0;
+	}
+
+	switch (search->options->io_method) {
+	case READ_IO:
+		map = 0;
+		break;
+	case MMAP_IO:
+		map = 1;
+		break;
+	case AUTO_IO:
+	default:
+		map = (uint64_t) file_stat->st_size >=
+		      search->thresholds.min_mmap_size;
+		break;
+	}
+
+	return map && !fstat(in, in_stat) &&
+	       in_stat->st_size == file_stat->st_size;
+}
+
+/*
+ * Choose the kernels with which to scan a file, by its size,
+ * unless the user forced a choice.
+ * Vector kernels cost more than they save on the shortest files.
+ * search:	the state of the search, including the thresholds,
+ *		which stores the kernels
+ * size:	the number of bytes in the file
+ * returns	the level of the chosen kernels
+ */
+static enum scan_kernel_level choose_kernels(struct search *search,
+					     size_t size)
+{
+	const struct string_finder_options *options = search->options;
+	enum scan_kernel_level level = options->kernel_level;
+
+	if (!options->force_kernels) {
+		level = size >= search->thresholds.min_vector_size ?
+			search->thresholds.vector_level : SCALAR_KERNELS;
+	}
+	search->kernels = get_scan_kernels(level);
+	return level;
+}
+
+/*
+ * Perform action on a file in memory,
+ * only if all the characters are text characters.
+ * search:		the state of the search,
+ *			and the first argument for "action"
+ * buffer:		the contents of the file,
+ *			and the second argument to "action"
+ * in_file_name:	the name of the file,
+ *			and the third and final argument to "action"
+ * action:		the buffer-reading action to perform
+ * returns		0 on success or the file contains non-text characters,
+ *			-1 on failure, with errno set by "action"
+ */
+static int scan_text_buffer(struct search *search,
+			    const struct text_buffer *buffer,
+			    const char *in_file_name,
+			    int (*action)(struct search *search,
+					  const struct text_buffer *buffer,
+					  const char *in_file_name))
+{
+	int non_text, error;
+
+	if (is_unchanged(search, buffer, in_file_name)) {
+		return 0;
+	}
+
+	PROBE2(classify_start, in_file_name, buffer->size);
+	non_text = has_non_text(buffer, search->kernels,
+				search->options->encoding);
+	PROBE2(classify_done, in_file_name, non_text);
+	if (non_text) {
+		return 0;
+	}
+
+	search->n_found = 0;
+	PROBE2(scan_start, in_file_name, buffer->size);
+	error = action(search, buffer, in_file_name);
+	PROBE3(scan_done, in_file_name, buffer->size, search->n_found);
+	return error;
+}
+
+/*
+ * Perform action on file, which is converted into a buffer,
+ * only if all the characters are text characters.
+ * The file is either copied into the search's buffer or mapped,
+ * and scanned with the kernels chosen for its size.
+ * search:		the state of the search,
+ *			and the first argument for "action"
+ * in:			the file descriptor from which to read
+ *			the file into a buffer,
+ *			which is the second argument to "action",
+ *			or -1 if the file is already in the search's buffer
+ * in_file_name:	the name of the file from which to read,
+ *			and the third and final argument to "action"
+ * action:		the buffer-reading action to perform
+ * returns		0 on success or the file contains non-text characters,
+ *			-1 on failure, with errno set by
+ *			   "fill_text_buffer" or "map_text_buffer"
+ *			   if reading the input failed,
+ *			   or by "action"
+ */
+static int do_text_buffer_action(struct search *search, int in,
+				 const char *in_file_name,
+				 int (*action)(struct search *search,
+					       const struct text_buffer *buffer,
+					       const char *in_file_name))
+{
+	const struct text_buffer *buffer = &search->buffer;
+	struct text_buffer mapped;
+	struct stat in_stat;
+	int map = in >= 0 && should_map_file(search, in, &in_stat);
+	enum scan_kernel_level level;
+	int error;
+
+	if (in >= 0) {
+		PROBE1(read_start, in_file_name);
+		if (map) {
+			error = map_text_buffer(&mapped, in, &in_stat);
+			buffer = &mapped;
+		} else {
+			error = fill_text_buffer(&search->buffer, in,
+						 search->file_stat);
+		}
+		PROBE2(read_done, in_file_name, error ? 0 : buffer->size);
+		if (error) {
+			printlg(ERROR_LEVEL, "Failed to generate buffer.\n");
+			return -1;
+		}
+	}
+
+	level = choose_kernels(search, buffer->size);
+	PROBE3(engine, in_file_name, map, level);
+
+	error = scan_text_buffer(search, buffer, in_file_name, action);
+	if (map && unmap_text_buffer(&mapped)) {
+		printlg(WARNING_LEVEL,
+			"File %s was truncated while it was searched, "
+			"so its end was read as zeros.\n", in_file_name);
+	}
+	return error;
+}
+
+/*
+ * the template for the warning to print if
+ * a line was completed without finding the end of a string.
+ * Arguments are file name (char *) and line number (unsigned).
+ */
+#define INCOMPLETE_WARNING	"File %s, line %u " \
+				"might not contain a real, complete string.\n"
+
+/*
+ * the template for the marker printed in place of skipped bytes.
+ * The argument is the offset in the file (unsigned long)
+ * at which printing resumes.
+ */
+#define ELISION_FORMAT		"[...@%lu]"
+/*
+ * Print the marker showing that bytes were skipped.
+ * out:		the output stream to which to print the marker
+ * file_start:	the beginning of the file
+ * resume:	the position at which printing resumes
+ */
+static void print_elision(FILE *out, const char *file_start,
+			  const char *resume)
+{
+	fprintf(out, ELISION_FORMAT, (unsigned long) (resume - file_start));
+}
+
+/* the bits that mark a UTF-8 continuation byte, and their value */
+#define CONTINUATION_MASK	0xc0
+#define CONTINUATION_BITS	0x80
+/*
+ * Print a string, including its quotation marks,
+ * cutting out its middle if it is longer than the limit.
+ * A shortened string keeps its closing quotation mark, if it has one,
+ * and is not cut in the middle of a UTF-8 character.
+ * out:		the output stream to which to print the string
+ * file_start:	the beginning of the file, for the elision marker
+ * opening:	the opening quotation mark
+ * closing:	the end of the string, as returned by "skip_string"
+ * how:		how the string ended, as stored by "skip_string"
+ * max_bytes:	the number of bytes to print before cutting the string,
+ *		or 0 to print the whole string
+ */
+static void print_string(FILE *out, const char *file_start,
+			 const char *opening, const char *closing,
+			 enum string_end how, size_t max_bytes)
+{
+	/* The closing quotation mark is always printed. */
+	const char *body_end = how == CLOSED_STRING ? closing - 1 : closing;
+	const char *cut;
+
+	if (max_bytes == 0 || (size_t) (body_end - opening) <= max_bytes) {
+		fwrite(opening, 1, closing - opening, out);
+		return;
+	}
+
+	cut = opening + max_bytes;
+	while (cut > opening + 1 &&
+	       (*cut & CONTINUATION_MASK) == CONTINUATION_BITS) {
+		cut--;
+	}
+	fwrite(opening, 1, cut - opening, out);
+	print_elision(out, file_start, body_end);
+	fwrite(body_end, 1, closing - body_end, out);
+}
+
+/* a string found in a file */
+struct found_string {
+	/* the opening quotation mark */
+	const char *opening;
+	/* the end of the string, as returned by "skip_string" */
+	const char *closing;
+	/* how the string ended */
+	enum string_end how;
+	/* the number of the line containing the string */
+	size_t line_number;
+};
+
+/*
+ * Given a buffer to a file only containing text characters,
+ * call a function on each of the separate strings.
+ * Outside of a string, only quotation marks matter,
+ * so the search jumps between them,
+ * and only counts the skipped line breaks when a string is found.
+ * search:		the state of the search, passed on to "visitor"
+ * buffer:		the file input buffer in which to search for strings
+ * in_file_name:	the name of the file from which to read
+ * visitor:		the function to call on each string,
+ *			which returns 0 on success, and -1 on failure
+ * returns		0 on success,
+ *			-1 as soon as "visitor" fails
+ */
+static int visit_strings(struct search *search,
+			 const struct text_buffer *buffer,
+			 const char *in_file_name,
+			 int (*visitor)(struct search *search,
+					const struct text_buffer *buffer,
+					const char *in_file_name,
+					const struct found_string *string))
+{
+	const struct scan_kernels *kernels = search->kernels;
+	const char *end = buffer->data + buffer->size;
+	const char *cursor = buffer->data;
+	/* the position up to which line breaks have been counted */
+	const char *counted = buffer->data;
+	struct found_string string;
+
+	string.line_number = 1;
+	while ((cursor = kernels->find_either_byte(cursor, end, STRING_MARKER,
+						   CHAR_MARKER)) < end) {
+		string.opening = cursor;
+		string.line_number += kernels->count_byte(counted,
+							  string.opening,
+							  LINE_BREAK);
+		counted = string.opening;
+
+		string.closing = skip_string(string.opening, end, &string.how);
+		search->n_found++;
+		if (visitor(search, buffer, in_file_name, &string)) {
+			return -1;
+		}
+		cursor = string.closing;
+	}
+
+	return 0;
+}
+
+/*
+ * Print the location of a string, and every character in it,
+ * including escape characters and the quotation marks.
+ * search:		the state of the search, including the output stream
+ * buffer:		the buffer containing the string
+ * in_file_name:	the name of the file containing the string
+ * string:		the string to print
+ * returns		0
+ */
+static int print_found_string(struct search *search,
+			      const struct text_buffer *buffer,
+			      const char *in_file_name,
+			      const struct found_string *string)
+{
+	FILE *out = search->out;
+
+	print_line_location(out, in_file_name, string->line_number);
+	print_string(out, buffer->data, string->opening, string->closing,
+		     string->how, search->options->max_string_bytes);
+
+	switch (string->how) {
+	case BROKEN_STRING:
+		printlg(WARNING_LEVEL, INCOMPLETE_WARNING,
+			in_file_name, (unsigned) string->line_number);
+		/* fall through */
+	case CLOSED_STRING:
+		fprintf(out, "\n");
+		break;
+	case TRUNCATED_STRING:
+		/* The final line break after the file ends the string. */
+		break;
+	}
+
+	return 0;
+}
+
+/*
+ * Given a buffer to a file only containing text characters,
+ * find and print the separate strings.
+ * search:		the state of the search, including the output stream
+ * buffer:		the file input buffer in which to search for strings
+ * in_file_name:	the name of the file from which to read
+ * returns		0
+ */
+static int _find_strings_action(struct search *search,
+				const struct text_buffer *buffer,
+				const char *in_file_name)
+{
+	int error = visit_strings(search, buffer, in_file_name,
+				  print_found_string);
+
+	fprintf(search->out, "\n");
+	return error;
+}
+
+/*
+ * Separately print the strings in the file,
+ * indicating their file and line number.
+ * search:		the state of the search, including the output stream
+ * in:			the file descriptor from which to read the file
+ * in_file_name:	the name of the file from which to read
+ * returns		0 on success or the file contains non-text characters,
+ *			-1 on failure, with errno set by
+ *			   "fill_text_buffer" if reading the input failed
+ */
+static int find_strings_action(struct search *search, int in,
+			       const char *in_file_name)
+{
+	return do_text_buffer_action(search, in, in_file_name,
+				     _find_strings_action);
+}
+
+/*
+ * Count a string in the tally for the current file.
+ * search:		the state of the search, including the tally
+ * buffer:		the buffer containing the string
+ * in_file_name:	the name of the file containing the string
+ * string:		the string to count
+ * returns		0 on success,
+ *			-1 on failure, with errno set by "tally_string"
+ */
+static int tally_found_string(struct search *search,
+			      const struct text_buffer *buffer,
+			      const char *in_file_name,
+			      const struct found_string *string)
+{
+	(void) buffer;
+
+	if (tally_string(&search->tally, string->opening,
+			 string->closing - string->opening,
+			 string->line_number)) {
+		printlg(ERROR_LEVEL, "Failed to count string in %s.\n",
+			in_file_name);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Add the strings in a file to the baseline being collected.
+ * search:		the state of the search, including the baseline
+ * buffer:		the file input buffer in which to search for strings
+ * in_file_name:	the name of the file from which to read
+ * returns		0 on success,
+ *			-1 on failure, with errno set by
+ *			   "tally_string" or "add_baseline_file"
+ */
+static int _save_baseline_action(struct search *search,
+				 const struct text_buffer *buffer,
+				 const char *in_file_name)
+{
+	int error = visit_strings(search, buffer, in_file_name,
+				  tally_found_string);
+
+	if (!error && add_baseline_file(&search->baseline,
+					relative_path(search, in_file_name),
+					hash_bytes(buffer->data, buffer->size),
+					&search->tally)) {
+		printlg(ERROR_LEVEL, "Failed to add %s to baseline.\n",
+			in_file_name);
+		error = -1;
+	}
+
+	clear_string_tally(&search->tally);
+	return error;
+}
+
+/*
+ * Add the strings in a file to the baseline being collected.
+ * search:		the state of the search, including the baseline
+ * in:			the file descriptor from which to read the file
+ * in_file_name:	the name of the file from which to read
+ * returns		0 on success or the file contains non-text characters,
+ *			-1 on failure, with errno set by
+ *			   "fill_text_buffer" if reading the input failed,
+ *			   or by "_save_baseline_action"
+ */
+static int save_baseline_action(struct search *search, int in,
+				const char *in_file_name)
+{
+	return do_text_buffer_action(search, in, in_file_name,
+				     _save_baseline_action);
+}
+
+/*
+ * Print the strings in a changed file
+ * that were added or removed since the baseline.
+ * search:		the state of the search, including the baseline
+ * buffer:		the file input buffer in which to search for strings
+ * in_file_name:	the name of the file from which to read
+ * returns		0 on success,
+ *			-1 on failure, with errno set by "tally_string"
+ */
+static int _diff_baseline_action(struct search *search,
+				 const struct text_buffer *buffer,
+				 const char *in_file_name)
+{
+	int error = visit_strings(search, buffer, in_file_name,
+				  tally_found_string);
+
+	if (!error) {
+		print_string_changes(search->out,
+				     relative_path(search, in_file_name),
+				     search->old_file, &search->tally);
+	}
+
+	clear_string_tally(&search->tally);
+	return error;
+}
+
+/*
+ * Print the strings in a file that were added or removed
+ * since the baseline, unless the file is unchanged.
+ * search:		the state of the search, including the baseline
+ * in:			the file descriptor from which to read the file
+ * in_file_name:	the name of the file from which to read
+ * returns		0 on success or the file contains non-text characters,
+ *			-1 on failure, with errno set by
+ *			   "fill_text_buffer" if reading the input failed,
+ *			   or by "_diff_baseline_action"
+ */
+static int diff_baseline_action(struct search *search, int in,
+				const char *in_file_name)
+{
+	return do_text_buffer_action(search, in, in_file_name,
+				     _diff_baseline_action);
+}
+
+/*
+ * Add a string to the index being collected.
+ * search:		the state of the search, including the index
+ * buffer:		the buffer containing the string
+ * in_file_name:	the name of the file containing the string
+ * string:		the string to add
+ * returns		0 on success,
+ *			-1 on failure, with errno set by "add_index_string"
+ */
+static int index_found_string(struct search *search,
+			      const struct text_buffer *buffer,
+			      const char *in_file_name,
+			      const struct found_string *string)
+{
+	(void) buffer;
+
+	if (add_index_string(&search->index, string->opening,
+			     string->closing - string->opening,
+			     string->line_number)) {
+		printlg(ERROR_LEVEL, "Failed to index string in %s.\n",
+			in_file_name);
+		return -1;
+	}
+	return 0;
+}
 
-	return error;
+/*
+ * Add the strings in a file to the index being collected.
+ * search:		the state of the search, including the index
+ * buffer:		the file input buffer in which to search for strings
+ * in_file_name:	the name of the file from which to read
+ * returns		0 on success,
+ *			-1 on failure, with errno set by
+ *			   "add_index_file" or "add_index_string"
+ */
+static int _build_index_action(struct search *search,
+			       const struct text_buffer *buffer,
+			       const char *in_file_name)
+{
+	if (add_index_file(&search->index, in_file_name)) {
+		printlg(ERROR_LEVEL, "Failed to add %s to index.\n",
+			in_file_name);
+		return -1;
+	}
+	return visit_strings(search, buffer, in_file_name,
+			     index_found_string);
 }
 
 /*
- * Separately print the strings in the file,
- * indicating their file and line number.
- * out:			the output stream to which to print
- * in:			the file input stream in which to search for strings
+ * Add the strings in a file to the index being collected.
+ * search:		the state of the search, including the index
+ * in:			the file descriptor from which to read the file
  * in_file_name:	the name of the file from which to read
  * returns		0 on success or the file contains non-text characters,
  *			-1 on failure, with errno set by
- *			   "init_file_buffer" if initializing the input buffer
- *			   failed,
- *			   or by "fgetc_buffer" if the file unexpectedly ended
+ *			   "fill_text_buffer" if reading the input failed,
+ *			   or by "_build_index_action"
  */
-static int find_strings_action(FILE *out, FILE *in, const char *in_file_name)
+static int build_index_action(struct search *search, int in,
+			      const char *in_file_name)
 {
-	return do_text_buffer_action(out, in, in_file_name,
-				     _find_strings_action);
+	return do_text_buffer_action(search, in, in_file_name,
+				     _build_index_action);
 }
 
-int find_strings(FILE *out, const char *root_path)
+/*
+ * Add a string to the sketch of the whole search,
+ * and to the estimate for the current directory.
+ * search:		the state of the search, including the sketches
+ * buffer:		the buffer containing the string
+ * in_file_name:	the name of the file containing the string
+ * string:		the string to add
+ * returns		0
+ */
+static int sketch_found_string(struct search *search,
+			       const struct text_buffer *buffer,
+			       const char *in_file_name,
+			       const struct found_string *string)
+{
+	size_t length = string->closing - string->opening;
+	uint64_t hash = hash_bytes(string->opening, length);
+
+	(void) buffer;
+	(void) in_file_name;
+
+	add_string_sketch(&search->sketch, string->opening, length, hash);
+	if (search->sketch_depth > 0) {
+		add_hyperloglog(search->directory_sketches +
+				search->sketch_depth - 1, hash);
+	}
+	return 0;
+}
+
+/*
+ * Add the strings in a file to the sketches.
+ * search:		the state of the search, including the sketches
+ * buffer:		the file input buffer in which to search for strings
+ * in_file_name:	the name of the file from which to read
+ * returns		0
+ */
+static int _sketch_action(struct search *search,
+			  const struct text_buffer *buffer,
+			  const char *in_file_name)
+{
+	return visit_strings(search, buffer, in_file_name,
+			     sketch_found_string);
+}
+
+/*
+ * Add the strings in a file to the sketches.
+ * search:		the state of the search, including the sketches
+ * in:			the file descriptor from which to read the file
+ * in_file_name:	the name of the file from which to read
+ * returns		0 on success or the file contains non-text characters,
+ *			-1 on failure, with errno set by
+ *			   "fill_text_buffer" if reading the input failed
+ */
+static int sketch_action(struct search *search, int in,
+			 const char *in_file_name)
 {
-	return traverse_dir(out, root_path, find_strings_action);
+	return do_text_buffer_action(search, in, in_file_name,
+				     _sketch_action);
 }
 
 /*
@@ -388,199 +1676,616 @@ int find_strings(FILE *out, const char *root_path)
  * including the quotation marks themselves
  */
 #define STRING_COLOR		SET_COLOR("31;1")
+/*
+ * Print a string in color, shortened if it is too long,
+ * and warn if it is incomplete.
+ * search:		the state of the search, including the output stream
+ * file_start:		the beginning of the file
+ * in_file_name:	the name of the file from which to read
+ * line_number:		the line number, for the warning
+ * opening:		the opening quotation mark
+ * line_end:		the end of the line containing the string
+ * end:			the end of the file
+ * returns		the end of the string, as returned by "skip_string"
+ */
+static const char *print_colored_string(struct search *search,
+					const char *file_start,
+					const char *in_file_name,
+					size_t line_number,
+					const char *opening,
+					const char *line_end,
+					const char *end)
+{
+	FILE *out = search->out;
+	enum string_end how;
+	const char *closing = skip_string(opening, line_end, &how);
+
+	search->n_found++;
+	fprintf(out, STRING_COLOR);
+	print_string(out, file_start, opening, closing, how,
+		     search->options->max_string_bytes);
+	/*
+	 * The line break is past "line_end",
+	 * so a string it breaks appears truncated.
+	 */
+	if (how != CLOSED_STRING && line_end < end) {
+		printlg(WARNING_LEVEL, INCOMPLETE_WARNING,
+			in_file_name, (unsigned) line_number);
+	}
+	fprintf(out, END_COLOR);
+
+	return closing;
+}
+
+/*
+ * Print the parts of a line that is too long to print whole:
+ * each string, with up to half of the line limit
+ * of the surrounding bytes on each side.
+ * The skipped bytes are replaced by elision markers.
+ * search:		the state of the search, including the output stream
+ * file_start:		the beginning of the file
+ * in_file_name:	the name of the file from which to read
+ * line_number:		the line number, for warnings
+ * line_start:		the beginning of the line
+ * line_end:		the end of the line
+ * end:			the end of the file
+ */
+static void print_line_windows(struct search *search, const char *file_start,
+			       const char *in_file_name, size_t line_number,
+			       const char *line_start, const char *line_end,
+			       const char *end)
+{
+	FILE *out = search->out;
+	const struct scan_kernels *kernels = search->kernels;
+	size_t context = search->options->max_line_bytes / 2;
+	/* the position up to which the line has been printed or skipped */
+	const char *printed = line_start;
+	const char *opening = kernels->find_either_byte(line_start, line_end,
+							STRING_MARKER,
+							CHAR_MARKER);
+
+	while (opening < line_end) {
+		const char *window_start = printed;
+		const char *closing, *next_opening, *window_end;
+		size_t max_gap;
+
+		if ((size_t) (opening - printed) > context) {
+			window_start = opening - context;
+			print_elision(out, file_start, window_start);
+		}
+		fwrite(window_start, 1, opening - window_start, out);
+
+		closing = print_colored_string(search, file_start,
+					       in_file_name, line_number,
+					       opening, line_end, end);
+
+		/*
+		 * Print the gap to the next string entirely
+		 * if its window would overlap with this one.
+		 */
+		next_opening = kernels->find_either_byte(closing, line_end,
+							 STRING_MARKER,
+							 CHAR_MARKER);
+		max_gap = next_opening < line_end ? 2 * context : context;
+		window_end = next_opening;
+		if ((size_t) (next_opening - closing) > max_gap) {
+			window_end = closing + context;
+		}
+		fwrite(closing, 1, window_end - closing, out);
+
+		printed = window_end;
+		opening = next_opening;
+	}
+
+	if (printed < line_end) {
+		print_elision(out, file_start, line_end);
+	}
+}
+
 /*
  * We have found at least one string in the line,
  * and therefore need to print the whole string,
  * with the strings colored.
- * out:			the output stream to which to print
- * buffer:		the buffer from which to read the line characters
+ * If the line is longer than the limit,
+ * only the strings and their surroundings are printed.
+ * search:		the state of the search, including the output stream
+ * file_start:		the beginning of the file
  * in_file_name:	the name of the file from which to read
  * line_number:		the line number to print
- * line_start:		the position of the beginning of the line
- *			to which to rewind
- * returns		0 on success,
- *			-1 on failure, with errno set by
- *			   "fseek_buffer" if rewinding
- *			   to the beginning of the line failed,
- *			   or by "fgetc_buffer" if the file unexpectedly ended
+ * line_start:		the beginning of the line
+ * end:			the end of the file
+ * returns		the position after the line break ending the line,
+ *			or the end of the file if the line is the last one
  */
-static int print_strings_in_line(FILE *out, file_buffer_t *buffer,
-				 const char *in_file_name, size_t line_number,
-				 long line_start)
+static const char *print_strings_in_line(struct search *search,
+					 const char *file_start,
+					 const char *in_file_name,
+					 size_t line_number,
+					 const char *line_start,
+					 const char *end)
 {
-	enum string_state state;
-	char marker_char;
-	size_t file_size;
-
-	print_line_location(out, in_file_name, line_number);
+	FILE *out = search->out;
+	size_t max_line_bytes = search->options->max_line_bytes;
+	const char *line_end = memchr(line_start, LINE_BREAK, end - line_start);
+	const char *cursor = line_start;
 
-	if (fseek_buffer(buffer, line_start, SEEK_SET)) {
-		printlg(ERROR_LEVEL,
-			"Failed to rewind to beginning of line.\n");
-		return -1;
+	if (line_end == NULL) {
+		line_end = end;
 	}
 
-	file_size = get_file_size(buffer);
-	state = NO_STRING;
-	while (ftell_buffer(buffer) < (long) file_size) {
-		int current_input = fgetc_buffer(buffer);
-		unsigned char current_char;
-		int end_color;
+	print_line_location(out, in_file_name, line_number);
 
-		if (current_input == EOF) {
-			printlg(ERROR_LEVEL, "Unexpected end of file "
-					     "while in file %s, line %u.\n",
-				in_file_name, (unsigned) line_number);
-			return -1;
-		}
+	if (max_line_bytes > 0 &&
+	    (size_t) (line_end - line_start) > max_line_bytes) {
+		print_line_windows(search, file_start, in_file_name,
+				   line_number, line_start, line_end, end);
+		cursor = line_end;
+	}
 
-		current_char = (char) current_input;
+	while (cursor < line_end) {
+		const char *opening =
+			search->kernels->find_either_byte(cursor, line_end,
+							  STRING_MARKER,
+							  CHAR_MARKER);
 
-		/* If we found a line break, we have succeeded. */
-		if (current_char == LINE_BREAK) {
-			if (state != NO_STRING) {
-				printlg(WARNING_LEVEL, INCOMPLETE_WARNING,
-					in_file_name, (unsigned) line_number);
-				fprintf(out, END_COLOR);
-			}
-			fprintf(out, "\n");
-			return 0;
+		/* Print all characters in the line. */
+		fwrite(cursor, 1, opening - cursor, out);
+		if (opening == line_end) {
+			break;
 		}
 
-		end_color = 0;
 		/* We have entered the string, and need to print it in color. */
-		if (state == NO_STRING) {
-			if (current_char == STRING_MARKER ||
-			    current_char == CHAR_MARKER) {
-				state = NORMAL_CHAR;
-				marker_char = current_char;
-				fprintf(out, STRING_COLOR);
-			}
-		} else {
-			if (state == ESCAPED_CHAR) {
-				/*
-				 * The last character was an escape character,
-				 * so ignore the meaning of this character.
-				 */
-				state = NORMAL_CHAR;
-			} else if (current_char == marker_char) {
-				/*
-				 * We have found an unescaped quotation mark,
-				 * so stop coloring after printing it.
-				 */
-				state = NO_STRING;
-				end_color = 1;
-			} else if (current_char == ESCAPE_MARKER) {
-				/* We have found an escape character. */
-				state = ESCAPED_CHAR;
-			}
-		}
-
-		/* Print all characters in the line. */
-		fprintf(out, "%c", current_char);
-		if (end_color) {
-			fprintf(out, END_COLOR);
-		}
+		cursor = print_colored_string(search, file_start, in_file_name,
+					      line_number, opening, line_end,
+					      end);
 	}
+	fprintf(out, "\n");
 
-	/*
-	 * It is impossible to finish iterating through the file
-	 * without reaching the end of the file or line.
-	 */
-	debug_assert(0);
-	return -1;
+	return line_end < end ? line_end + 1 : end;
 }
 
 /*
  * Given a file buffer containing only text characters,
  * read through lines, printing out any that contain strings.
- * out:			the output stream to which to print
+ * Lines without strings are skipped by jumping between quotation marks,
+ * and counting the line breaks in between.
+ * search:		the state of the search, including the output stream
  * buffer:		the buffer in which to search for strings
  * in_file_name:	the name of the file from which to read
- * returns		0 on success,
- *			-1 on failure, with errno set by
- *			   "fgetc_buffer" if the file unexpectedly ended,
- *			   or by "print_strings_in_line"
+ * returns		0
  */
-static int _find_string_lines_action(FILE *out, file_buffer_t *buffer,
+static int _find_string_lines_action(struct search *search,
+				     const struct text_buffer *buffer,
 				     const char *in_file_name)
 {
-	size_t file_size = get_file_size(buffer);
+	FILE *out = search->out;
+	const struct scan_kernels *kernels = search->kernels;
+	const char *end = buffer->data + buffer->size;
+	const char *cursor = buffer->data;
+	const char *line_start = buffer->data;
 	size_t line_number = 1;
-	int error = 0;
-	long line_start;
 
-	while ((line_start = ftell_buffer(buffer)) < (long) file_size) {
-		int line_continues = 1;
+	while ((cursor = kernels->find_either_byte(cursor, end, STRING_MARKER,
+						   CHAR_MARKER)) < end) {
+		size_t n_line_breaks = kernels->count_byte(line_start, cursor,
+							   LINE_BREAK);
 
-		while (line_continues && ftell_buffer(buffer) <
-		       (long) file_size) {
-			int current_input = fgetc_buffer(buffer);
-			unsigned char current_char;
-
-			if (current_input == EOF) {
-				printlg(ERROR_LEVEL,
-					"Unexpected end of file, %s, "
-					"while searching line for strings.\n",
-					in_file_name);
-				line_continues = 0;
-				error = -1;
-				break;
-			}
-
-			if (isprint(current_input)) {
-			}
-
-			current_char = (char) current_input;
-			if (current_char == LINE_BREAK) {
-				/*
-				 * Reached the end of the line without
-				 * finding a string.
-				 */
-				line_continues = 0;
-			} else if (current_char == STRING_MARKER ||
-				   current_char == CHAR_MARKER) {
-				/*
-				 * Found a string in the line, so print it,
-				 * and go to the next line.
-				 */
-				error = print_strings_in_line(out, buffer,
-							      in_file_name,
-							      line_number,
-							      line_start);
-
-				if (error) {
-					break;
-				}
-
-				line_continues = 0;
-			}
+		if (n_line_breaks > 0) {
+			/* Back up to the start of the string's line. */
+			line_number += n_line_breaks;
+			line_start = memrchr(line_start, LINE_BREAK,
+					     cursor - line_start);
+			line_start++;
 		}
+
+		/*
+		 * Found a string in the line, so print it,
+		 * and go to the next line.
+		 */
+		cursor = print_strings_in_line(search, buffer->data,
+					       in_file_name, line_number,
+					       line_start, end);
+		line_start = cursor;
 		line_number++;
 	}
 	fprintf(out, "\n");
 
-	return error;
+	return 0;
 }
 
 /*
  * Read through lines, printing out any that contain strings.
- * out:			the output stream to which to print
- * in:			the file input stream in which to search for strings
+ * search:		the state of the search, including the output stream
+ * in:			the file descriptor from which to read the file
  * in_file_name:	the name of the file from which to read
  * returns		0 on success, or the file contains non-text characters,
  *			-1 on failure, with errno set by
- *			   "fgetc_buffer" if the file unexpectedly ended,
- *			   or by "print_strings_in_line"
+ *			   "fill_text_buffer" if reading the input failed
  */
-static int find_string_lines_action(FILE *out, FILE *in,
+static int find_string_lines_action(struct search *search, int in,
 				    const char *in_file_name)
 {
-	return do_text_buffer_action(out, in, in_file_name,
+	return do_text_buffer_action(search, in, in_file_name,
 				     _find_string_lines_action);
 }
 
+void init_string_finder_options(struct string_finder_options *options)
+{
+	options->whole_line = 0;
+	options->encoding = ASCII_ENCODING;
+	options->follow_symlinks = 1;
+	options->one_file_system = 0;
+	options->max_line_bytes = 0;
+	options->max_string_bytes = 0;
+	options->save_baseline_path = NULL;
+	options->diff_baseline_path = NULL;
+	options->build_index_path = NULL;
+	options->sketch = 0;
+	options->sketch_size = DEFAULT_SKETCH_SIZE;
+	options->sketch_top = DEFAULT_SKETCH_TOP;
+	options->save_sketch_path = NULL;
+	options->git_rev = NULL;
+	options->git_base_rev = NULL;
+	options->io_method = AUTO_IO;
+	options->force_kernels = 0;
+	options->kernel_level = SCALAR_KERNELS;
+	options->engine_config_path = NULL;
+	options->shard_index = 0;
+	options->n_shards = 0;
+	options->balance_shards = 0;
+}
+
+/*
+ * Search for strings, and save them as a baseline,
+ * instead of printing them.
+ * search:	the state of the search, with the settings filled in
+ * returns	0 on success,
+ *		-1 on failure, with errno set by
+ *		   "fopen" or "write_baseline" if saving failed,
+ *		   or by "traverse_files"
+ */
+static int save_baseline(struct search *search)
+{
+	const char *baseline_path = search->options->save_baseline_path;
+	FILE *baseline_file;
+	int error;
+
+	if (traverse_files(search, save_baseline_action)) {
+		return -1;
+	}
+
+	if ((baseline_file = fopen(baseline_path, "wb")) == NULL) {
+		printlg(ERROR_LEVEL, "Failed to open baseline %s.\n",
+			baseline_path);
+		return -1;
+	}
+	error = write_baseline(&search->baseline, baseline_file);
+	if (fclose(baseline_file)) {
+		error = -1;
+	}
+	if (error) {
+		printlg(ERROR_LEVEL, "Failed to write baseline %s.\n",
+			baseline_path);
+	}
+
+	return error;
+}
+
+/*
+ * Search for strings,
+ * and only print the ones that were added or removed since the baseline.
+ * search:	the state of the search, with the settings filled in
+ * returns	0 on success,
+ *		-1 on failure, with errno set by
+ *		   "fopen" or "read_baseline" if loading failed,
+ *		   or by "traverse_files"
+ */
+static int diff_baseline(struct search *search)
+{
+	const char *baseline_path = search->options->diff_baseline_path;
+	FILE *baseline_file = fopen(baseline_path, "rb");
+	int error;
+
+	if (baseline_file == NULL) {
+		printlg(ERROR_LEVEL, "Failed to open baseline %s.\n",
+			baseline_path);
+		return -1;
+	}
+	error = read_baseline(&search->baseline, baseline_file);
+	fclose(baseline_file);
+	if (error) {
+		printlg(ERROR_LEVEL, "Failed to read baseline %s.\n",
+			baseline_path);
+		return -1;
+	}
+
+	if (traverse_files(search, diff_baseline_action)) {
+		return -1;
+	}
+	/* Only the changed files of a git revision are searched. */
+	if (search->options->git_base_rev == NULL) {
+		print_removed_files(search->out, &search->baseline);
+	}
+
+	return 0;
+}
+
+/*
+ * Search for strings, and save them as an index
+ * for later substring queries, instead of printing them.
+ * search:	the state of the search, with the settings filled in
+ * returns	0 on success,
+ *		-1 on failure, with errno set by
+ *		   "init_index_builder",
+ *		   "fopen" or "write_index" if saving failed,
+ *		   or by "traverse_files"
+ */
+static int build_index(struct search *search)
+{
+	const char *index_path = search->options->build_index_path;
+	FILE *index_file;
+	int error;
+
+	if (init_index_builder(&search->index)) {
+		printlg(ERROR_LEVEL, "Failed to create index.\n");
+		return -1;
+	}
+	if (traverse_files(search, build_index_action)) {
+		destroy_index_builder(&search->index);
+		return -1;
+	}
+
+	if ((index_file = fopen(index_path, "wb")) == NULL) {
+		printlg(ERROR_LEVEL, "Failed to open index %s.\n",
+			index_path);
+		destroy_index_builder(&search->index);
+		return -1;
+	}
+	error = write_index(&search->index, index_file);
+	if (fclose(index_file)) {
+		error = -1;
+	}
+	if (error) {
+		printlg(ERROR_LEVEL, "Failed to write index %s.\n",
+			index_path);
+	}
+
+	destroy_index_builder(&search->index);
+	return error;
+}
+
+/*
+ * Collect the sizes of all files, so that each shard gets
+ * about the same number of bytes, then search this shard's files.
+ * search:	the state of the search, with the settings filled in
+ * file_action:	the actions to perform on each file in this shard
+ * returns	0 on success,
+ *		-1 on failure, with errno set by
+ *		   "make_shard_plan" if the files could not be assigned,
+ *		   or by "traverse_files"
+ */
+static int search_balanced_shard(struct search *search,
+				 int (*file_action)(struct search *search,
+						    int in,
+						    const char *path))
+{
+	const struct string_finder_options *options = search->options;
+	int error;
+
+	init_shard_plan(&search->plan);
+
+	search->planning = 1;
+	error = traverse_files(search, NULL);
+	search->planning = 0;
+	search->n_files = 0;
+
+	if (!error && make_shard_plan(&search->plan, options->n_shards)) {
+		printlg(ERROR_LEVEL, "Failed to assign files to shards.\n");
+		error = -1;
+	}
+	if (!error) {
+		error = traverse_files(search, file_action);
+	}
+
+	destroy_shard_plan(&search->plan);
+	return error;
+}
+
+/*
+ * Search this shard's files, or every file if the search is not split.
+ * search:	the state of the search, with the settings filled in
+ * file_action:	the actions to perform on each file in this shard
+ * returns	0 on success,
+ *		-1 on failure, with errno set by
+ *		   "search_balanced_shard" or "traverse_files"
+ */
+static int search_shard(struct search *search,
+			int (*file_action)(struct search *search, int in,
+					   const char *path))
+{
+	const struct string_finder_options *options = search->options;
+
+	if (options->n_shards > 0 && options->balance_shards) {
+		return search_balanced_shard(search, file_action);
+	}
+	return traverse_files(search, file_action);
+}
+
+/*
+ * Search for strings, and only print approximate statistics about them,
+ * using a fixed amount of memory regardless of the number of strings,
+ * or save the statistics to merge them with other shards later.
+ * search:	the state of the search, with the settings filled in
+ * returns	0 on success,
+ *		-1 on failure, with errno set by
+ *		   "init_string_sketch",
+ *		   "fopen" or "write_string_sketch" if saving failed,
+ *		   or by "search_shard"
+ */
+static int sketch_strings(struct search *search)
+{
+	const struct string_finder_options *options = search->options;
+	int error;
+
+	if (init_string_sketch(&search->sketch, options->sketch_size,
+			       options->sketch_top)) {
+		printlg(ERROR_LEVEL, "Failed to create sketch.\n");
+		return -1;
+	}
+
+	error = search_shard(search, sketch_action);
+
+	while (search->n_directory_sketches > 0) {
+		destroy_hyperloglog(search->directory_sketches +
+				    --search->n_directory_sketches);
+	}
+	free(search->directory_sketches);
+
+	if (!error && options->save_sketch_path != NULL) {
+		FILE *sketch_file = fopen(options->save_sketch_path, "wb");
+
+		if (sketch_file == NULL) {
+			printlg(ERROR_LEVEL, "Failed to open sketch %s.\n",
+				options->save_sketch_path);
+			error = -1;
+		} else {
+			error = write_string_sketch(&search->sketch,
+						    sketch_file);
+			if (fclose(sketch_file)) {
+				error = -1;
+			}
+			if (error) {
+				printlg(ERROR_LEVEL,
+					"Failed to write sketch %s.\n",
+					options->save_sketch_path);
+			}
+		}
+	} else if (!error) {
+		print_string_sketch(search->out, &search->sketch);
+	}
+
+	destroy_string_sketch(&search->sketch);
+	return error;
+}
+
+/*
+ * Load the thresholds choosing how each file is read and scanned,
+ * measuring them if they are not cached yet,
+ * unless the user forced either choice, for benchmarking,
+ * which is then not slowed down by measuring.
+ * If the user forced both choices, the thresholds are not used at all.
+ * search:	the state of the search, with the settings filled in,
+ *		which stores the thresholds
+ * returns	0 on success,
+ *		-1 on failure, with errno set to ENOTSUP
+ *		   if the forced kernels are not supported
+ */
+static int load_thresholds(struct search *search)
+{
+	const struct string_finder_options *options = search->options;
+
+	if (options->force_kernels &&
+	    get_scan_kernels(options->kernel_level) == NULL) {
+		printlg(ERROR_LEVEL,
+			"This machine does not support the chosen kernels.\n");
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	default_engine_thresholds(&search->thresholds);
+	if (options->engine_config_path == NULL ||
+	    (options->io_method != AUTO_IO && options->force_kernels)) {
+		return 0;
+	}
+	load_engine_thresholds(&search->thresholds,
+			       options->engine_config_path,
+			       options->io_method == AUTO_IO &&
+			       !options->force_kernels);
+	return 0;
+}
+
+/*
+ * Search with the mode chosen by the options.
+ * search:	the state of the search, with the settings filled in
+ * returns	0 on success, -1 otherwise
+ */
+static int search_with_options(struct search *search)
+{
+	const struct string_finder_options *options = search->options;
+	int error;
+
+	if (options->build_index_path != NULL) {
+		return build_index(search);
+	}
+	if (options->sketch) {
+		return sketch_strings(search);
+	}
+	if (options->save_baseline_path == NULL &&
+	    options->diff_baseline_path == NULL) {
+		return search_shard(search, options->whole_line ?
+					    find_string_lines_action :
+					    find_strings_action);
+	}
+
+	if (init_baseline(&search->baseline)) {
+		printlg(ERROR_LEVEL, "Failed to create baseline.\n");
+		return -1;
+	}
+	if (init_string_tally(&search->tally)) {
+		printlg(ERROR_LEVEL, "Failed to create string tally.\n");
+		destroy_baseline(&search->baseline);
+		return -1;
+	}
+
+	if (options->save_baseline_path != NULL) {
+		error = save_baseline(search);
+	} else {
+		error = diff_baseline(search);
+	}
+
+	destroy_string_tally(&search->tally);
+	destroy_baseline(&search->baseline);
+	return error;
+}
+
+int find_strings_with_options(FILE *out, const char *root_path,
+			      const struct string_finder_options *options)
+{
+	struct search search = {
+		.out = out,
+		.options = options,
+		.root_path = root_path,
+	};
+	int error = load_thresholds(&search);
+
+	if (!error) {
+		error = search_with_options(&search);
+	}
+
+	destroy_text_buffer(&search.buffer);
+
+	PROBE0(flush_start);
+	if (fflush(out)) {
+		printlg(ERROR_LEVEL, "Failed to write output.\n");
+		error = -1;
+	}
+	PROBE1(flush_done, error);
+	return error;
+}
+
+int find_strings(FILE *out, const char *root_path)
+{
+	struct string_finder_options options;
+
+	init_string_finder_options(&options);
+	return find_strings_with_options(out, root_path, &options);
+}
+
 int find_string_lines(FILE *out, const char *root_path)
 {
-	return traverse_dir(out, root_path, find_string_lines_action);
+	struct string_finder_options options;
+
+	init_string_finder_options(&options);
+	options.whole_line = 1;
+	return find_strings_with_options(out, root_path, &options);
 }
@@ -1,12 +1,21 @@
 #include <string_finder.h>
+#include <shard.h>
+#include <literal_index.h>
+#include <sketch.h>
+#include <engine.h>
 
 #include <logger.h>
 
-/* argument index for directory or path name */
-#define DIR_INDEX		1
-/* always require path name */
-#define MIN_N_ARGS		(DIR_INDEX + 1)
-/* argument index for optional printing mode */
+#include <getopt.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+
+/* always require path name, after the options */
+#define MIN_N_ARGS		1
+/* argument index for optional printing mode, after the path name */
 #define LINE_OPTION_INDEX	MIN_N_ARGS
 #define MAX_N_ARGS		(LINE_OPTION_INDEX + 1)
 
@@ -15,33 +24,603 @@
 /* option for printing whole line containing string */
 #define LINE_OPTION		'l'
 
+/*
+ * the size of the buffer staging the output before it is written,
+ * when it is not a terminal
+ */
+#define OUTPUT_BUFFER_SIZE	(1 << 16)
+
+/* values identifying long options */
+enum long_option {
+	ENCODING_OPTION = 256,
+	FOLLOW_OPTION,
+	NO_FOLLOW_OPTION,
+	ONE_FILE_SYSTEM_OPTION,
+	MAX_LINE_BYTES_OPTION,
+	MAX_LITERAL_BYTES_OPTION,
+	SAVE_BASELINE_OPTION,
+	DIFF_BASELINE_OPTION,
+	SHARD_OPTION,
+	SHARD_BY_SIZE_OPTION,
+	MERGE_OPTION,
+	BUILD_INDEX_OPTION,
+	QUERY_OPTION,
+	SKETCH_OPTION,
+	SKETCH_BYTES_OPTION,
+	SKETCH_TOP_OPTION,
+	SAVE_SKETCH_OPTION,
+	MERGE_SKETCHES_OPTION,
+	GIT_REV_OPTION,
+	GIT_DIFF_OPTION,
+	ENGINE_OPTION,
+	ENGINE_CONFIG_OPTION
+};
+
+/* the long options accepted before the path */
+static const struct option long_options[] = {
+	{"encoding", required_argument, NULL, ENCODING_OPTION},
+	{"follow-symlinks", no_argument, NULL, FOLLOW_OPTION},
+	{"no-follow", no_argument, NULL, NO_FOLLOW_OPTION},
+	{"one-file-system", no_argument, NULL, ONE_FILE_SYSTEM_OPTION},
+	{"max-line-bytes", required_argument, NULL, MAX_LINE_BYTES_OPTION},
+	{"max-literal-bytes", required_argument, NULL,
+	 MAX_LITERAL_BYTES_OPTION},
+	{"save-baseline", required_argument, NULL, SAVE_BASELINE_OPTION},
+	{"diff-baseline", required_argument, NULL, DIFF_BASELINE_OPTION},
+	{"shard", required_argument, NULL, SHARD_OPTION},
+	{"shard-by-size", no_argument, NULL, SHARD_BY_SIZE_OPTION},
+	{"merge", no_argument, NULL, MERGE_OPTION},
+	{"build-index", required_argument, NULL, BUILD_INDEX_OPTION},
+	{"query", required_argument, NULL, QUERY_OPTION},
+	{"sketch", no_argument, NULL, SKETCH_OPTION},
+	{"sketch-bytes", required_argument, NULL, SKETCH_BYTES_OPTION},
+	{"sketch-top", required_argument, NULL, SKETCH_TOP_OPTION},
+	{"save-sketch", required_argument, NULL, SAVE_SKETCH_OPTION},
+	{"merge-sketches", no_argument, NULL, MERGE_SKETCHES_OPTION},
+	{"git-rev", required_argument, NULL, GIT_REV_OPTION},
+	{"git-diff", required_argument, NULL, GIT_DIFF_OPTION},
+	{"engine", required_argument, NULL, ENGINE_OPTION},
+	{"engine-config", required_argument, NULL, ENGINE_CONFIG_OPTION},
+	{NULL, 0, NULL, 0}
+};
+
+/* the names of the encodings accepted by "--encoding" */
+#define ASCII_NAME	"ascii"
+#define UTF8_NAME	"utf8"
+
+/*
+ * Parse the name of a text encoding.
+ * name:	the name given on the command line
+ * encoding:	stores the encoding
+ * returns	0 on success, -1 if the name is unknown
+ */
+static int parse_encoding(const char *name, enum text_encoding *encoding)
+{
+	if (strcmp(name, ASCII_NAME) == 0) {
+		*encoding = ASCII_ENCODING;
+	} else if (strcmp(name, UTF8_NAME) == 0) {
+		*encoding = UTF8_ENCODING;
+	} else {
+		printlg(ERROR_LEVEL,
+			"Invalid encoding, \"%s\". "
+			"Enter either \"%s\" or \"%s\".\n",
+			name, ASCII_NAME, UTF8_NAME);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Parse a count, of bytes or of anything else.
+ * text:	the count given on the command line
+ * name:	the name of the option, for the error message
+ * count:	stores the count
+ * returns	0 on success, -1 if the text is not a number
+ */
+static int parse_count(const char *text, const char *name, size_t *count)
+{
+	char *text_end;
+	unsigned long value;
+
+	errno = 0;
+	value = strtoul(text, &text_end, 10);
+	if (errno != 0 || text_end == text || *text_end != '\0' ||
+	    *text == '-') {
+		printlg(ERROR_LEVEL,
+			"Invalid count for \"--%s\", \"%s\".\n",
+			name, text);
+		return -1;
+	}
+
+	*count = value;
+	return 0;
+}
+
+/* the character between the shard index and the number of shards */
+#define SHARD_SEPARATOR	'/'
+/*
+ * Parse the shard to search, in the form "[index]/[number of shards]",
+ * where the index counts from 0.
+ * text:	the shard given on the command line
+ * options:	stores the shard index and number of shards
+ * returns	0 on success, -1 if the text is not a valid shard
+ */
+static int parse_shard(const char *text,
+		       struct string_finder_options *options)
+{
+	char *text_end;
+	unsigned long shard_index, n_shards;
+
+	errno = 0;
+	shard_index = strtoul(text, &text_end, 10);
+	if (errno == 0 && text_end != text && *text_end == SHARD_SEPARATOR &&
+	    *text != '-') {
+		const char *count_start = text_end + 1;
+
+		n_shards = strtoul(count_start, &text_end, 10);
+		if (errno == 0 && text_end != count_start &&
+		    *text_end == '\0' && *count_start != '-' &&
+		    shard_index < n_shards && n_shards <= MAX_N_SHARDS) {
+			options->shard_index = shard_index;
+			options->n_shards = n_shards;
+			return 0;
+		}
+	}
+
+	printlg(ERROR_LEVEL,
+		"Invalid shard, \"%s\". Enter \"[index]/[number of shards]\", "
+		"with the index counting from 0, "
+		"and at most %u shards.\n", text, MAX_N_SHARDS);
+	return -1;
+}
+
+/* the names accepted by "--engine", besides those of the kernels */
+#define AUTO_ENGINE_NAME	"auto"
+#define READ_ENGINE_NAME	"read"
+#define MMAP_ENGINE_NAME	"mmap"
+/* the characters between the choices given to "--engine" */
+#define ENGINE_SEPARATORS	","
+/*
+ * Parse the ways to read and scan every file, as a list of choices
+ * separated by commas, such as "mmap,avx2".
+ * "read" or "mmap" forces the way of reading files,
+ * the name of a set of kernels forces the kernels,
+ * and "auto" lets both be chosen for each file again.
+ * text:	the choices given on the command line,
+ *		which is split in place
+ * options:	stores the choices
+ * returns	0 on success, -1 if a choice is unknown
+ */
+static int parse_engine(char *text, struct string_finder_options *options)
+{
+	char *name, *rest;
+
+	for (name = strtok_r(text, ENGINE_SEPARATORS, &rest); name != NULL;
+	     name = strtok_r(NULL, ENGINE_SEPARATORS, &rest)) {
+		if (strcmp(name, AUTO_ENGINE_NAME) == 0) {
+			options->io_method = AUTO_IO;
+			options->force_kernels = 0;
+		} else if (strcmp(name, READ_ENGINE_NAME) == 0) {
+			options->io_method = READ_IO;
+		} else if (strcmp(name, MMAP_ENGINE_NAME) == 0) {
+			options->io_method = MMAP_IO;
+		} else if (parse_kernel_level(name,
+					      &options->kernel_level) == 0) {
+			options->force_kernels = 1;
+		} else {
+			printlg(ERROR_LEVEL,
+				"Invalid engine, \"%s\". Enter \"%s\", "
+				"\"%s\" or \"%s\", or the kernels, "
+				"\"%s\", \"%s\" or \"%s\", "
+				"separated by commas.\n",
+				name, AUTO_ENGINE_NAME, READ_ENGINE_NAME,
+				MMAP_ENGINE_NAME,
+				kernel_level_name(SCALAR_KERNELS),
+				kernel_level_name(SSE2_KERNELS),
+				kernel_level_name(AVX2_KERNELS));
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* the name of the file caching the engine thresholds */
+#define ENGINE_CONFIG_NAME	"string_finder_engine"
+/* the user's cache directory, relative to the home directory */
+#define HOME_CACHE_DIR		".cache"
+/*
+ * Find the default file caching the engine thresholds,
+ * in "$XDG_CACHE_HOME", or else in "$HOME/.cache".
+ * returns	the path, which is valid until the next call,
+ *		or NULL if there is no cache directory
+ */
+static const char *default_engine_config_path(void)
+{
+	static char path[PATH_MAX];
+	const char *cache_dir = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	int length;
+
+	if (cache_dir != NULL && *cache_dir != '\0') {
+		length = snprintf(path, sizeof(path), "%s/%s", cache_dir,
+				  ENGINE_CONFIG_NAME);
+	} else if (home != NULL && *home != '\0') {
+		length = snprintf(path, sizeof(path), "%s/%s/%s", home,
+				  HOME_CACHE_DIR, ENGINE_CONFIG_NAME);
+	} else {
+		return NULL;
+	}
+
+	if (length < 0 || (size_t) length >= sizeof(path)) {
+		return NULL;
+	}
+	return path;
+}
+
+/*
+ * Check that a git revision given on the command line
+ * cannot be mistaken by git for an option.
+ * rev:		the revision
+ * returns	0 if the revision is valid, -1 otherwise
+ */
+static int check_git_rev(const char *rev)
+{
+	if (*rev == '\0' || *rev == '-') {
+		printlg(ERROR_LEVEL, "Invalid git revision, \"%s\".\n", rev);
+		return -1;
+	}
+	return 0;
+}
+
+/* the characters between the revisions compared by "--git-diff" */
+#define GIT_RANGE_SEPARATOR	".."
+/*
+ * Parse the git revisions to compare, in the form "[base]..[revision]".
+ * text:	the revisions given on the command line,
+ *		which is split in place
+ * options:	stores the revisions
+ * returns	0 on success, -1 if the text is not a valid range
+ */
+static int parse_git_diff(char *text, struct string_finder_options *options)
+{
+	char *separator = strstr(text, GIT_RANGE_SEPARATOR);
+	char *rev;
+
+	if (separator == NULL ||
+	    strstr(separator + 1, GIT_RANGE_SEPARATOR) != NULL) {
+		printlg(ERROR_LEVEL,
+			"Invalid git range, \"%s\". "
+			"Enter \"[base]..[revision]\".\n", text);
+		return -1;
+	}
+	*separator = '\0';
+	rev = separator + strlen(GIT_RANGE_SEPARATOR);
+	if (check_git_rev(text) || check_git_rev(rev)) {
+		return -1;
+	}
+
+	options->git_base_rev = text;
+	options->git_rev = rev;
+	return 0;
+}
+
+/*
+ * Merge the outputs of the shards of a search, and print the result.
+ * paths:	the paths to the files containing the outputs
+ * n_paths:	the number of files
+ * returns	0 on success, -1 otherwise
+ */
+static int merge_shards(char **paths, int n_paths)
+{
+	FILE *inputs[n_paths > 0 ? n_paths : 1];
+	int n_opened;
+	int error = 0;
+
+	if (n_paths < 1) {
+		printlg(ERROR_LEVEL, "Please enter the outputs to merge.\n");
+		return -1;
+	}
+
+	for (n_opened = 0; n_opened < n_paths; n_opened++) {
+		inputs[n_opened] = fopen(paths[n_opened], "r");
+		if (inputs[n_opened] == NULL) {
+			printlg(ERROR_LEVEL, "Failed to open file %s.\n",
+				paths[n_opened]);
+			error = -1;
+			break;
+		}
+	}
+
+	if (!error) {
+		error = merge_shard_outputs(stdout, inputs, n_paths);
+	}
+
+	while (n_opened > 0) {
+		fclose(inputs[--n_opened]);
+	}
+	return error;
+}
+
+/*
+ * Merge the sketches saved by the shards of a search,
+ * then print the result, or save it to merge it again later.
+ * paths:	the paths to the files containing the sketches
+ * n_paths:	the number of files
+ * save_path:	the path to which to save the merged sketch,
+ *		or NULL to print it
+ * returns	0 on success, -1 otherwise
+ */
+static int merge_sketches(char **paths, int n_paths, const char *save_path)
+{
+	struct string_sketch merged;
+	FILE *out;
+	int path_i;
+	int error = 0;
+
+	if (n_paths < 1) {
+		printlg(ERROR_LEVEL, "Please enter the sketches to merge.\n");
+		return -1;
+	}
+
+	for (path_i = 0; !error && path_i < n_paths; path_i++) {
+		struct string_sketch sketch;
+		FILE *in = fopen(paths[path_i], "rb");
+
+		if (in == NULL) {
+			printlg(ERROR_LEVEL, "Failed to open sketch %s.\n",
+				paths[path_i]);
+			error = -1;
+			break;
+		}
+		error = read_string_sketch(path_i == 0 ? &merged : &sketch,
+					   in);
+		fclose(in);
+		if (error) {
+			printlg(ERROR_LEVEL, "Failed to read sketch %s.\n",
+				paths[path_i]);
+			break;
+		}
+
+		if (path_i > 0) {
+			if (merge_string_sketch(&merged, &sketch)) {
+				printlg(ERROR_LEVEL,
+					"Sketch %s has a different size.\n",
+					paths[path_i]);
+				error = -1;
+			}
+			destroy_string_sketch(&sketch);
+		}
+	}
+	if (error) {
+		if (path_i > 0) {
+			destroy_string_sketch(&merged);
+		}
+		return -1;
+	}
+
+	if (save_path == NULL) {
+		print_string_sketch(stdout, &merged);
+	} else if ((out = fopen(save_path, "wb")) == NULL) {
+		printlg(ERROR_LEVEL, "Failed to open sketch %s.\n", save_path);
+		error = -1;
+	} else {
+		error = write_string_sketch(&merged, out);
+		if (fclose(out)) {
+			error = -1;
+		}
+		if (error) {
+			printlg(ERROR_LEVEL, "Failed to write sketch %s.\n",
+				save_path);
+		}
+	}
+
+	destroy_string_sketch(&merged);
+	return error;
+}
+
 int main(int argc, char *argv[])
 {
+	struct string_finder_options options;
 	char display_option;
+	char **args;
+	int n_args;
+	int option;
+	int merge = 0;
+	int merge_sketch_files = 0;
+	const char *query_path = NULL;
+	static char output_buffer[OUTPUT_BUFFER_SIZE];
+
+	/* Write the output in large blocks, unless someone is watching. */
+	if (!isatty(STDOUT_FILENO)) {
+		setvbuf(stdout, output_buffer, _IOFBF, sizeof(output_buffer));
+	}
 
-	if (argc < MIN_N_ARGS) {
+	init_string_finder_options(&options);
+	while ((option = getopt_long(argc, argv, "", long_options,
+				     NULL)) != -1) {
+		switch (option) {
+		case ENCODING_OPTION:
+			if (parse_encoding(optarg, &options.encoding)) {
+				return -1;
+			}
+			break;
+		case FOLLOW_OPTION:
+			options.follow_symlinks = 1;
+			break;
+		case NO_FOLLOW_OPTION:
+			options.follow_symlinks = 0;
+			break;
+		case ONE_FILE_SYSTEM_OPTION:
+			options.one_file_system = 1;
+			break;
+		case MAX_LINE_BYTES_OPTION:
+			if (parse_count(optarg, "max-line-bytes",
+					&options.max_line_bytes)) {
+				return -1;
+			}
+			break;
+		case MAX_LITERAL_BYTES_OPTION:
+			if (parse_count(optarg, "max-literal-bytes",
+					&options.max_string_bytes)) {
+				return -1;
+			}
+			break;
+		case SAVE_BASELINE_OPTION:
+			options.save_baseline_path = optarg;
+			break;
+		case DIFF_BASELINE_OPTION:
+			options.diff_baseline_path = optarg;
+			break;
+		case SHARD_OPTION:
+			if (parse_shard(optarg, &options)) {
+				return -1;
+			}
+			break;
+		case SHARD_BY_SIZE_OPTION:
+			options.balance_shards = 1;
+			break;
+		case MERGE_OPTION:
+			merge = 1;
+			break;
+		case BUILD_INDEX_OPTION:
+			options.build_index_path = optarg;
+			break;
+		case QUERY_OPTION:
+			query_path = optarg;
+			break;
+		case SKETCH_OPTION:
+			options.sketch = 1;
+			break;
+		case SKETCH_BYTES_OPTION:
+			if (parse_count(optarg, "sketch-bytes",
+					&options.sketch_size)) {
+				return -1;
+			}
+			break;
+		case SKETCH_TOP_OPTION:
+			if (parse_count(optarg, "sketch-top",
+					&options.sketch_top)) {
+				return -1;
+			}
+			if (options.sketch_top > MAX_SKETCH_TOP) {
+				printlg(ERROR_LEVEL,
+					"Invalid count for \"--sketch-top\", "
+					"\"%s\". Enter at most %lu.\n",
+					optarg,
+					(unsigned long) MAX_SKETCH_TOP);
+				return -1;
+			}
+			break;
+		case SAVE_SKETCH_OPTION:
+			options.sketch = 1;
+			options.save_sketch_path = optarg;
+			break;
+		case MERGE_SKETCHES_OPTION:
+			merge_sketch_files = 1;
+			break;
+		case GIT_REV_OPTION:
+			if (check_git_rev(optarg)) {
+				return -1;
+			}
+			options.git_base_rev = NULL;
+			options.git_rev = optarg;
+			break;
+		case GIT_DIFF_OPTION:
+			if (parse_git_diff(optarg, &options)) {
+				return -1;
+			}
+			break;
+		case ENGINE_OPTION:
+			if (parse_engine(optarg, &options)) {
+				return -1;
+			}
+			break;
+		case ENGINE_CONFIG_OPTION:
+			options.engine_config_path = optarg;
+			break;
+		default:
+			return -1;
+		}
+	}
+	if (options.save_baseline_path != NULL &&
+	    options.diff_baseline_path != NULL) {
+		printlg(ERROR_LEVEL,
+			"Only save a baseline or compare against one, "
+			"not both.\n");
+		return -1;
+	}
+	if (options.n_shards > 0 && (options.save_baseline_path != NULL ||
+				     options.diff_baseline_path != NULL)) {
+		printlg(ERROR_LEVEL,
+			"Baselines cannot be split into shards.\n");
+		return -1;
+	}
+	if (options.build_index_path != NULL &&
+	    (options.save_baseline_path != NULL ||
+	     options.diff_baseline_path != NULL || options.n_shards > 0)) {
+		printlg(ERROR_LEVEL,
+			"An index cannot be built along with a baseline "
+			"or a shard.\n");
+		return -1;
+	}
+	if (options.sketch &&
+	    (options.save_baseline_path != NULL ||
+	     options.diff_baseline_path != NULL ||
+	     options.build_index_path != NULL)) {
+		printlg(ERROR_LEVEL,
+			"A sketch cannot be made along with a baseline "
+			"or an index.\n");
+		return -1;
+	}
+	if (options.git_rev != NULL && options.n_shards > 0) {
+		printlg(ERROR_LEVEL,
+			"A git revision cannot be split into shards.\n");
+		return -1;
+	}
+	args = argv + optind;
+	n_args = argc - optind;
+
+	if (merge) {
+		return merge_shards(args, n_args);
+	}
+	if (merge_sketch_files) {
+		return merge_sketches(args, n_args, options.save_sketch_path);
+	}
+
+	if (query_path != NULL) {
+		if (n_args != 1) {
+			printlg(ERROR_LEVEL,
+				"Please only enter the substring to find.\n");
+			return -1;
+		}
+		return query_index(stdout, query_path, *args);
+	}
+
+	if (n_args < MIN_N_ARGS) {
 		printlg(ERROR_LEVEL, "Please enter the path to search.\n");
 		return -1;
 	}
 
-	if (argc > MAX_N_ARGS) {
+	if (n_args > MAX_N_ARGS) {
 		printlg(ERROR_LEVEL,
 			"You should only enter the input directory, "
 			"and, optionally, the display option.\n");
 		return -1;
 	}
 
-	if (argc > MIN_N_ARGS) {
-		display_option = *argv[LINE_OPTION_INDEX];
+	if (n_args > MIN_N_ARGS) {
+		display_option = *args[LINE_OPTION_INDEX];
 	} else {
 		display_option = ALONE_OPTION;
 	}
 
 	switch (display_option) {
 	case ALONE_OPTION:
-		return find_strings(stdout, argv[DIR_INDEX]);
+		options.whole_line = 0;
+		break;
 	case LINE_OPTION:
-		return find_string_lines(stdout, argv[DIR_INDEX]);
+		options.whole_line = 1;
+		break;
 	default:
 		printlg(ERROR_LEVEL,
 			"Invalid display option, \"%c\". "
@@ -51,4 +630,9 @@ int main(int argc, char *argv[])
 			display_option, ALONE_OPTION, LINE_OPTION);
 		return -1;
 	}
+
+	if (options.engine_config_path == NULL) {
+		options.engine_config_path = default_engine_config_path();
+	}
+	return find_strings_with_options(stdout, *args, &options);
 }
@@ -69,9 +69,178 @@ struct string_finder_tv non_text_end_line = {
 	.whole_line = 1,
 };
 
+/* the name of the file whose last line has a string, but no line break */
+#define NO_FINAL_BREAK_FILE_NAME	"no_final_break"
+/* test the file without a final line break in string-only mode */
+struct string_finder_tv no_final_break_alone = {
+	.test_file_name = NO_FINAL_BREAK_FILE_NAME,
+	.result_file_name = NO_FINAL_BREAK_FILE_NAME "_alone",
+	.whole_line = 0,
+};
+/* test the file without a final line break in whole-line mode */
+struct string_finder_tv no_final_break_line = {
+	.test_file_name = NO_FINAL_BREAK_FILE_NAME,
+	.result_file_name = NO_FINAL_BREAK_FILE_NAME "_line",
+	.whole_line = 1,
+};
+
+/* the name of the file containing multibyte UTF-8 strings */
+#define UTF8_FILE_NAME		"utf8"
+/* test the UTF-8 file in string-only mode */
+struct string_finder_tv utf8_alone = {
+	.test_file_name = UTF8_FILE_NAME,
+	.result_file_name = UTF8_FILE_NAME "_alone",
+	.whole_line = 0,
+	.encoding = UTF8_ENCODING,
+};
+/* test the UTF-8 file in whole-line mode */
+struct string_finder_tv utf8_line = {
+	.test_file_name = UTF8_FILE_NAME,
+	.result_file_name = UTF8_FILE_NAME "_line",
+	.whole_line = 1,
+	.encoding = UTF8_ENCODING,
+};
+/* The UTF-8 file is not text in ASCII. */
+struct string_finder_tv utf8_as_ascii = {
+	.test_file_name = UTF8_FILE_NAME,
+	.result_file_name = BLANK_OUT_NAME,
+	.whole_line = 0,
+	.encoding = ASCII_ENCODING,
+};
+
+/* the name of the file ending with an incomplete UTF-8 sequence */
+#define BAD_UTF8_FILE_NAME	"bad_utf8"
+/* test the invalid UTF-8 file in string-only mode */
+struct string_finder_tv bad_utf8_alone = {
+	.test_file_name = BAD_UTF8_FILE_NAME,
+	.result_file_name = BLANK_OUT_NAME,
+	.whole_line = 0,
+	.encoding = UTF8_ENCODING,
+};
+/*
+ * Each of these files has a single invalid UTF-8 sequence
+ * among valid text, in the middle of a 16-byte block:
+ * an overlong form of a two-byte character, C0 80,
+ * an overlong form of a three-byte character, E0 80 80,
+ * a UTF-16 surrogate, ED A0 80,
+ * a code point above U+10FFFF, F4 90 80 80,
+ * and a continuation byte that follows no leading byte, 80.
+ */
+struct string_finder_tv overlong_2_utf8 = {
+	.test_file_name = "overlong_2_utf8",
+	.result_file_name = BLANK_OUT_NAME,
+	.whole_line = 0,
+	.encoding = UTF8_ENCODING,
+};
+struct string_finder_tv overlong_3_utf8 = {
+	.test_file_name = "overlong_3_utf8",
+	.result_file_name = BLANK_OUT_NAME,
+	.whole_line = 0,
+	.encoding = UTF8_ENCODING,
+};
+struct string_finder_tv surrogate_utf8 = {
+	.test_file_name = "surrogate_utf8",
+	.result_file_name = BLANK_OUT_NAME,
+	.whole_line = 0,
+	.encoding = UTF8_ENCODING,
+};
+struct string_finder_tv too_large_utf8 = {
+	.test_file_name = "too_large_utf8",
+	.result_file_name = BLANK_OUT_NAME,
+	.whole_line = 0,
+	.encoding = UTF8_ENCODING,
+};
+struct string_finder_tv stray_continuation_utf8 = {
+	.test_file_name = "stray_continuation_utf8",
+	.result_file_name = BLANK_OUT_NAME,
+	.whole_line = 0,
+	.encoding = UTF8_ENCODING,
+};
+/*
+ * A two-byte sequence cut short at the end of a 16-byte block, C3,
+ * and a four-byte sequence cut short at the end of a 32-byte block,
+ * F0 9F 98, each followed by an ASCII byte
+ * in a next block that is not all ASCII.
+ */
+struct string_finder_tv split_16_utf8 = {
+	.test_file_name = "split_16_utf8",
+	.result_file_name = BLANK_OUT_NAME,
+	.whole_line = 0,
+	.encoding = UTF8_ENCODING,
+};
+struct string_finder_tv split_32_utf8 = {
+	.test_file_name = "split_32_utf8",
+	.result_file_name = BLANK_OUT_NAME,
+	.whole_line = 0,
+	.encoding = UTF8_ENCODING,
+};
+/* the name of the file with valid characters split between blocks */
+#define SPLIT_VALID_UTF8_FILE_NAME	"split_valid_utf8"
+/*
+ * Characters split at the ends of the 16-, 32- and 48-byte blocks
+ * are still valid.
+ */
+struct string_finder_tv split_valid_utf8 = {
+	.test_file_name = SPLIT_VALID_UTF8_FILE_NAME,
+	.result_file_name = SPLIT_VALID_UTF8_FILE_NAME "_alone",
+	.whole_line = 0,
+	.encoding = UTF8_ENCODING,
+};
+/* Control characters are not text in UTF-8 either. */
+struct string_finder_tv non_text_start_utf8 = {
+	.test_file_name = NON_TEXT_START_FILE_NAME,
+	.result_file_name = BLANK_OUT_NAME,
+	.whole_line = 0,
+	.encoding = UTF8_ENCODING,
+};
+/* ASCII files are also UTF-8 files. */
+struct string_finder_tv unified_utf8 = {
+	.test_file_name = UNIFIED_FILE_NAME,
+	.result_file_name = UNIFIED_ALONE_OUT_NAME,
+	.whole_line = 0,
+	.encoding = UTF8_ENCODING,
+};
+
+/* the name of the file with a line too long to print whole */
+#define LONG_LINE_FILE_NAME	"long_line"
+/* the longest line to print whole in the long line tests */
+#define LONG_LINE_MAX_LINE	40
+/* the number of bytes of each string to print in the long line tests */
+#define LONG_LINE_MAX_STRING	16
+/* test shortening strings in string-only mode */
+struct string_finder_tv long_line_alone = {
+	.test_file_name = LONG_LINE_FILE_NAME,
+	.result_file_name = LONG_LINE_FILE_NAME "_alone",
+	.whole_line = 0,
+	.max_string_bytes = LONG_LINE_MAX_STRING,
+};
+/* test shortening lines and strings in whole-line mode */
+struct string_finder_tv long_line_line = {
+	.test_file_name = LONG_LINE_FILE_NAME,
+	.result_file_name = LONG_LINE_FILE_NAME "_line",
+	.whole_line = 1,
+	.max_line_bytes = LONG_LINE_MAX_LINE,
+	.max_string_bytes = LONG_LINE_MAX_STRING,
+};
+/* Limits longer than every line and string change nothing. */
+struct string_finder_tv unified_limited = {
+	.test_file_name = UNIFIED_FILE_NAME,
+	.result_file_name = UNIFIED_LINE_OUT_NAME,
+	.whole_line = 1,
+	.max_line_bytes = 100,
+	.max_string_bytes = 100,
+};
+
 struct string_finder_tv *string_finder_tvs[N_STRING_FINDER_TVS] = {
 	&unified_alone, &unified_line,
 	&non_text_alone, &non_text_line,
 	&non_text_start_alone, &non_text_start_line,
-	&non_text_end_alone, &non_text_end_line
+	&non_text_end_alone, &non_text_end_line,
+	&no_final_break_alone, &no_final_break_line,
+	&utf8_alone, &utf8_line, &utf8_as_ascii,
+	&bad_utf8_alone, &non_text_start_utf8, &unified_utf8,
+	&overlong_2_utf8, &overlong_3_utf8, &surrogate_utf8,
+	&too_large_utf8, &stray_continuation_utf8,
+	&split_16_utf8, &split_32_utf8, &split_valid_utf8,
+	&long_line_alone, &long_line_line, &unified_limited
 };
@@ -2,6 +2,8 @@
  * definition and declaration of test vector struct
  * for testing "find_strings" and "find_string_lines" on single files.
  */
+#include <string_finder.h>
+
 /* a test vector for one of the string searching functions */
 struct string_finder_tv {
 	/*
@@ -18,8 +20,14 @@ struct string_finder_tv {
 	char *result_file_name;
 	/* Will we run "find_string_lines"? If not, run "find_strings". */
 	int whole_line;
+	/* the encoding in which the file must be text to be searched */
+	enum text_encoding encoding;
+	/* the longest line to print whole, or 0 for no limit */
+	size_t max_line_bytes;
+	/* the number of bytes of each string to print, or 0 for no limit */
+	size_t max_string_bytes;
 };
 
-#define N_STRING_FINDER_TVS	8
+#define N_STRING_FINDER_TVS	27
 /* the test vectors that will be run by "test_string_finders" */
 extern struct string_finder_tv *string_finder_tvs[N_STRING_FINDER_TVS];
@@ -212,8 +212,410 @@ def run_test(print_line):
 	else:
 		print "Failed!"
 
+import os
+import shutil
+import tempfile
+
+# Run the "string_finder" program.
+# arguments:	the arguments to pass to the program
+# cwd:		the directory in which to run it, or None for this one
+# returns	its whole output
+def finder_output(arguments, cwd = None):
+	run = Popen([os.path.abspath(COMMAND)] + arguments, stdout = PIPE,
+		    cwd = cwd)
+	return run.communicate()[0]
+
+# Run the "string_finder" program.
+# arguments:	the arguments to pass to the program
+# returns	the lines of its output, without their line breaks
+def run_finder(arguments):
+	return finder_output(arguments).splitlines()
+
+# Run the "string_finder" program, discarding its output.
+# arguments:	the arguments to pass to the program
+# returns	its exit status, which is negative if it was killed by a signal
+def finder_status(arguments):
+	null_file = open(os.devnull, "w")
+	status = Popen([COMMAND] + arguments, stdout = null_file,
+		       stderr = null_file).wait()
+	null_file.close()
+	return status
+
+# Get the strings printed by the "string_finder" program,
+# without the files and lines in which they were found.
+# output_lines:	the lines of its output
+# returns	the list of strings, in the order printed
+def found_strings(output_lines):
+	return [line.split("\t", 1)[1] for line in output_lines \
+		if "\t" in line]
+
+# Write a file.
+# path:		the path of the file
+# text:		the contents of the file
+def write_file(path, text):
+	out_file = open(path, "w")
+	out_file.write(text)
+	out_file.close()
+
+# Print the result of a test.
+# passed:	Did the test pass?
+def report(passed):
+	if passed:
+		print "Passed!"
+	else:
+		print "Failed!"
+
+# Run a test on a directory in which the same file can be reached
+# through a hard link, a symbolic link and a symbolic link loop,
+# and check that it is only searched once.
+def run_link_test():
+	root = tempfile.mkdtemp()
+	try:
+		subdir = os.path.join(root, "subdir")
+		original = os.path.join(subdir, "original")
+		os.mkdir(subdir)
+		write_file(original, '"linked"\n')
+		os.link(original, os.path.join(root, "hard_link"))
+		os.symlink("original", os.path.join(subdir, "soft_link"))
+		os.symlink("..", os.path.join(subdir, "loop_to_parent"))
+
+		strings = found_strings(run_finder([root, ALONE_OPTION]))
+		report(strings == ['"linked"'])
+	finally:
+		shutil.rmtree(root)
+
+# the directory, usually on another file system,
+# used to check that "--one-file-system" skips other file systems
+OTHER_FILE_SYSTEM = "/dev/shm"
+# Run a test on a directory linking to a file on another file system,
+# which must only be searched without "--one-file-system".
+def run_one_file_system_test():
+	root = tempfile.mkdtemp()
+	if not os.path.isdir(OTHER_FILE_SYSTEM) or \
+	   os.stat(OTHER_FILE_SYSTEM).st_dev == os.stat(root).st_dev:
+		os.rmdir(root)
+		print "Skipped, as %s is not another file system."% \
+		      OTHER_FILE_SYSTEM
+		return
+
+	other_root = tempfile.mkdtemp(dir = OTHER_FILE_SYSTEM)
+	try:
+		write_file(os.path.join(root, "local"), '"local"\n')
+		write_file(os.path.join(other_root, "other"), '"other"\n')
+		os.symlink(other_root, os.path.join(root, "to_other"))
+
+		all_strings = found_strings(run_finder([root, ALONE_OPTION]))
+		local_strings = found_strings(run_finder(["--one-file-system",
+							 root,
+							 ALONE_OPTION]))
+		report(sorted(all_strings) == ['"local"', '"other"'] and \
+		       local_strings == ['"local"'])
+	finally:
+		shutil.rmtree(root)
+		shutil.rmtree(other_root)
+
+# Run a test that saves a baseline of a directory, changes the directory,
+# and checks that only the changes are printed:
+# nothing for an unchanged file,
+# the added and removed strings of a changed file,
+# and every string of a deleted file.
+def run_baseline_test():
+	root = tempfile.mkdtemp()
+	baseline_path = os.path.join(root, "baseline")
+	target = os.path.join(root, "target")
+	try:
+		os.mkdir(target)
+		write_file(os.path.join(target, "unchanged"), '"same"\n')
+		write_file(os.path.join(target, "changed"),
+			   '"kept" "removed"\n"kept"\n')
+		write_file(os.path.join(target, "deleted"), '"deleted"\n')
+		run_finder(["--save-baseline=" + baseline_path, target])
+
+		unchanged = run_finder(["--diff-baseline=" + baseline_path,
+					target])
+		write_file(os.path.join(target, "changed"),
+			   '"kept"\n\n"added" "added"\n')
+		os.remove(os.path.join(target, "deleted"))
+		changed = run_finder(["--diff-baseline=" + baseline_path,
+				      target])
+		report(unchanged == [] and \
+		       sorted(changed) == ['changed (3):\t+2\t"added"',
+					   'changed:\t-1\t"kept"',
+					   'changed:\t-1\t"removed"',
+					   'deleted:\t-1\t"deleted"'])
+	finally:
+		shutil.rmtree(root)
+
+# the numbers of shards into which to split the search
+# in the test of merging shards
+SHARD_COUNTS = [1, 2, 3]
+# Put the files in the output of a search that was not split
+# in the order of a search split into shards,
+# which searches the entries of each directory in the order of their names.
+# output:	the output of the search, in "alone" mode
+# returns	the output, with the files sorted
+def sort_output_files(output):
+	files = [text for text in output.split("\n\n") if text != ""]
+	files.sort(key = lambda text: text.split(" (", 1)[0].split("/"))
+	return "".join([text + "\n\n" for text in files])
+
+# the files to create in two copies of a directory,
+# in opposite orders, so that they may be listed in opposite orders
+LISTING_FILES = ["a", "b.c", "b/d", "b/e", "f"]
+# Run a test that splits the search of the test directory into shards,
+# with and without balancing them by size,
+# and checks that merging the outputs of the shards
+# gives exactly the output of the search that was not split,
+# with the files in sorted order,
+# even if the shards search copies that list their files differently,
+# and that the outputs of shards of different searches are not merged.
+def run_shard_test():
+	root = tempfile.mkdtemp()
+	try:
+		expected = sort_output_files(finder_output([SRC_DIR,
+							    ALONE_OPTION]))
+		passed = True
+		for balance_options in [[], ["--shard-by-size"]]:
+			for n_shards in SHARD_COUNTS:
+				shard_paths = []
+				for shard_i in range(n_shards):
+					shard_path = os.path.join(root, \
+						"shard_%d"%shard_i)
+					shard_option = "--shard=%d/%d"% \
+						       (shard_i, n_shards)
+					write_file(shard_path, finder_output( \
+						balance_options + \
+						[shard_option, SRC_DIR,
+						 ALONE_OPTION]))
+					shard_paths += [shard_path]
+				merged = finder_output(["--merge"] + \
+						       shard_paths)
+				if merged != expected:
+					print "Merging %d shards failed."% \
+					      n_shards
+					passed = False
+
+		shard_path = os.path.join(root, "shard_0")
+		if finder_status(["--merge", shard_path, shard_path]) == 0:
+			print "The same shard was merged twice."
+			passed = False
+
+		copies = [os.path.join(OTHER_FILE_SYSTEM, "forward"),
+			  os.path.join(OTHER_FILE_SYSTEM, "backward")]
+		try:
+			for copy_i in range(len(copies)):
+				os.mkdir(copies[copy_i])
+				os.mkdir(os.path.join(copies[copy_i], "b"))
+				order = LISTING_FILES
+				if copy_i > 0:
+					order = reversed(LISTING_FILES)
+				for name in order:
+					write_file(os.path.join( \
+						copies[copy_i], name),
+						'"%s"\n'%name)
+			expected = sort_output_files(finder_output( \
+				[".", ALONE_OPTION], cwd = copies[0]))
+			shard_paths = []
+			for shard_i in range(len(copies)):
+				shard_path = os.path.join(root,
+							  "copy_%d"%shard_i)
+				write_file(shard_path, finder_output( \
+					["--shard=%d/%d"%(shard_i,
+							  len(copies)),
+					 ".", ALONE_OPTION],
+					cwd = copies[shard_i]))
+				shard_paths += [shard_path]
+			if finder_output(["--merge"] + shard_paths) != \
+			   expected:
+				print "Merging shards of copies failed."
+				passed = False
+		finally:
+			for copy in copies:
+				shutil.rmtree(copy, True)
+		report(passed)
+	finally:
+		shutil.rmtree(root)
+
+import struct
+
+# the substring to query in the index of the test directory
+QUERY_SUBSTRING = "level_1"
+# the format of the start of an index's header, up to the offset of
+# the list of strings for each three-byte sequence
+INDEX_HEADER_FORMAT = "<8sII5Q7QQ"
+# Run a test that builds an index of the test directory,
+# and checks that querying it finds the same strings as a search,
+# and that a truncated index, and an index whose lists of strings
+# point outside of it, are rejected.
+def run_index_test():
+	root = tempfile.mkdtemp()
+	index_path = os.path.join(root, "index")
+	try:
+		run_finder(["--build-index=" + index_path, SRC_DIR])
+		queried = run_finder(["--query=" + index_path, QUERY_SUBSTRING])
+		searched = [line for line in \
+			    run_finder([SRC_DIR, ALONE_OPTION]) \
+			    if QUERY_SUBSTRING in line.split("\t", 1)[-1]]
+		passed = queried != [] and sorted(queried) == sorted(searched)
+
+		index_file = open(index_path, "rb")
+		index = index_file.read()
+		index_file.close()
+
+		write_file(index_path, index[: -1])
+		status = finder_status(["--query=" + index_path,
+					QUERY_SUBSTRING])
+		if status <= 0:
+			print "A truncated index was accepted."
+			passed = False
+
+		header = struct.unpack_from(INDEX_HEADER_FORMAT, index)
+		n_trigrams = header[6]
+		posting_starts_start = header[-1]
+		corrupt = index[: posting_starts_start] + \
+			  struct.pack("<Q", 1 << 62) * n_trigrams + \
+			  index[posting_starts_start + 8 * n_trigrams :]
+		write_file(index_path, corrupt)
+		status = finder_status(["--query=" + index_path,
+					QUERY_SUBSTRING])
+		if status <= 0:
+			print "An index pointing outside itself was accepted."
+			passed = False
+		report(passed)
+	finally:
+		shutil.rmtree(root)
+
+# the strings in each of the two directories sketched by the sketch test
+SKETCH_TEXTS = ['"hot" "hot" "hot" "warm" "warm" "cold"\n',
+		'"hot" "warm" "cold" "rare"\n']
+# the statistics expected for both directories together
+SKETCH_TOTALS = ["Strings:\t10", "Distinct strings:\t~4",
+		 '~4\t"hot"', '~3\t"warm"', '~2\t"cold"']
+# the option choosing the number of most frequent strings to print
+SKETCH_TOP_OPTION = "--sketch-top=3"
+# the most frequent strings that can be printed
+MAX_SKETCH_TOP = 262144
+# Run a test that sketches two directories, both separately and together,
+# and checks the most frequent strings,
+# and that merging the sketches of the directories
+# gives the same statistics as sketching them together,
+# even with as many frequent strings as can be printed,
+# but that more cannot be asked for.
+def run_sketch_test():
+	root = tempfile.mkdtemp()
+	try:
+		sketch_paths = []
+		for dir_i in range(len(SKETCH_TEXTS)):
+			dir_path = os.path.join(root, "dir_%d"%dir_i)
+			sketch_path = os.path.join(root, "sketch_%d"%dir_i)
+			os.mkdir(dir_path)
+			write_file(os.path.join(dir_path, "strings"),
+				   SKETCH_TEXTS[dir_i])
+			run_finder(["--sketch", SKETCH_TOP_OPTION,
+				    "--save-sketch=" + sketch_path, dir_path])
+			sketch_paths += [sketch_path]
+
+		# Leave out the estimates for each directory.
+		together = [line for line in \
+			    run_finder(["--sketch", SKETCH_TOP_OPTION, root]) \
+			    if not line.startswith(root)]
+		merged = run_finder(["--merge-sketches"] + sketch_paths)
+		passed = together == SKETCH_TOTALS and merged == together
+
+		top_option = "--sketch-top=%d"%MAX_SKETCH_TOP
+		run_finder(["--sketch", top_option,
+			    "--save-sketch=" + sketch_paths[0], root])
+		merged = [line for line in \
+			  run_finder(["--merge-sketches", sketch_paths[0]]) \
+			  if line.startswith("~")]
+		if merged != SKETCH_TOTALS[2 :] + ['~1\t"rare"']:
+			print "Merging a sketch with the most strings failed."
+			passed = False
+		top_option = "--sketch-top=%d"%(MAX_SKETCH_TOP + 1)
+		if finder_status(["--sketch", top_option, root]) == 0:
+			print "Too many frequent strings were accepted."
+			passed = False
+		report(passed)
+	finally:
+		shutil.rmtree(root)
+
+from subprocess import call
+
+# Run git in a repository, with its output discarded.
+# repo:		the path of the repository
+# arguments:	the arguments to pass to git
+# returns	the exit status of git
+def run_git(repo, arguments):
+	null_file = open(os.devnull, "w")
+	status = call(["git", "-C", repo, "-c", "user.name=test",
+		       "-c", "user.email=test@example.com"] + arguments,
+		      stdout = null_file, stderr = null_file)
+	null_file.close()
+	return status
+
+# Run a test that makes a repository with two commits,
+# changing, adding and deleting files and adding a symbolic link,
+# and checks the files searched in each revision, and between them,
+# which are read from the repository rather than the working tree.
+def run_git_test():
+	repo = tempfile.mkdtemp()
+	try:
+		if run_git(repo, ["init", "-q"]) != 0:
+			print "Skipped, as git is not available."
+			return
+		os.mkdir(os.path.join(repo, "subdir"))
+		write_file(os.path.join(repo, "kept"), '"kept"\n')
+		write_file(os.path.join(repo, "changed"), '"old"\n')
+		write_file(os.path.join(repo, "deleted"), '"deleted"\n')
+		write_file(os.path.join(repo, "subdir", "nested"),
+			   '"nested"\n')
+		run_git(repo, ["add", "-A"])
+		run_git(repo, ["commit", "-q", "-m", "first"])
+
+		write_file(os.path.join(repo, "changed"), '"new"\n')
+		write_file(os.path.join(repo, "added"), '"added"\n')
+		os.remove(os.path.join(repo, "deleted"))
+		os.symlink("kept", os.path.join(repo, "link"))
+		run_git(repo, ["add", "-A"])
+		run_git(repo, ["commit", "-q", "-m", "second"])
+		write_file(os.path.join(repo, "kept"), '"uncommitted"\n')
+
+		# Leave out the blank lines between files.
+		first = filter(None, run_finder(["--git-rev=HEAD~1", repo,
+						 ALONE_OPTION]))
+		second = filter(None, run_finder(["--git-rev=HEAD", repo,
+						  ALONE_OPTION]))
+		changes = filter(None, run_finder(["--git-diff=HEAD~1..HEAD",
+						   repo, ALONE_OPTION]))
+		report(sorted(first) == ['changed (1):\t"old"',
+					 'deleted (1):\t"deleted"',
+					 'kept (1):\t"kept"',
+					 'subdir/nested (1):\t"nested"'] and \
+		       sorted(second) == ['added (1):\t"added"',
+					  'changed (1):\t"new"',
+					  'kept (1):\t"kept"',
+					  'subdir/nested (1):\t"nested"'] and \
+		       sorted(changes) == ['added (1):\t"added"',
+					   'changed (1):\t"new"'])
+	finally:
+		shutil.rmtree(repo)
+
 if __name__ == "__main__":
 	print "Running test that only looks for strings"
 	run_test(False)
 	print "Running test that looks for lines containing strings"
 	run_test(True)
+	print "Running test that reaches a file through several links"
+	run_link_test()
+	print "Running test that links to another file system"
+	run_one_file_system_test()
+	print "Running test that compares against a baseline"
+	run_baseline_test()
+	print "Running test that merges the shards of a search"
+	run_shard_test()
+	print "Running test that queries an index"
+	run_index_test()
+	print "Running test that merges sketches"
+	run_sketch_test()
+	print "Running test that searches git revisions"
+	run_git_test()
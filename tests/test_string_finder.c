@@ -35,28 +35,47 @@ static FILE *open_read_file(const char *dir, const char *fname)
 }
 
 #include <string_finder.h>
+#include <engine.h>
 #include <compare_files.h>
 
+/* a way of reading and scanning files, with which to run every test */
+struct test_engine {
+	/* the way of reading files */
+	enum io_method io_method;
+	/* Force the kernels? If not, they are chosen by size. */
+	int force_kernels;
+	/* the kernels to force */
+	enum scan_kernel_level kernel_level;
+};
+
 /*
  * Given all of the input file streams,
- * run the test on "find_string_lines" or "find_strings".
+ * run the test on "find_strings_with_options".
  * output_storage:	the input/output stream to which to write,
  *			and to compare to the expected output
  * tv:			test vector containing the file to read
+ * engine:		the way of reading and scanning the file
  * expected_output:	stores the expected output
  * returns		1 if passed, 0 otherwise
  */
 static int _test_string_finder(FILE *output_storage,
 			       struct string_finder_tv *tv,
+			       const struct test_engine *engine,
 			       FILE *expected_output)
 {
+	struct string_finder_options options;
 	int error;
 
-	if (tv->whole_line) {
-		error = find_string_lines(output_storage, tv->test_file_name);
-	} else {
-		error = find_strings(output_storage, tv->test_file_name);
-	}
+	init_string_finder_options(&options);
+	options.whole_line = tv->whole_line;
+	options.encoding = tv->encoding;
+	options.max_line_bytes = tv->max_line_bytes;
+	options.max_string_bytes = tv->max_string_bytes;
+	options.io_method = engine->io_method;
+	options.force_kernels = engine->force_kernels;
+	options.kernel_level = engine->kernel_level;
+	error = find_strings_with_options(output_storage, tv->test_file_name,
+					  &options);
 
 	if (error) {
 		printlg(ERROR_LEVEL, "Failed to perform line reading test.\n");
@@ -86,9 +105,11 @@ static int _test_string_finder(FILE *output_storage,
  * tv:		the test to run.
  *		Contains the name of the input file,
  *		and the name of the file containing the expected output
+ * engine:	the way of reading and scanning the file
  * returns	1 if passed, 0 otherwise
  */
-static int test_string_finder(struct string_finder_tv *tv)
+static int test_string_finder(struct string_finder_tv *tv,
+			      const struct test_engine *engine)
 {
 	FILE *expected_output = open_read_file(OUTPUTS_DIR,
 					       tv->result_file_name);
@@ -107,7 +128,7 @@ static int test_string_finder(struct string_finder_tv *tv)
 			"Failed to open temporary file to store output.\n");
 	} else {
 		passed = _test_string_finder(output_storage,
-					     tv, expected_output);
+					     tv, engine, expected_output);
 		fclose(output_storage);
 	}
 
@@ -121,13 +142,41 @@ static int test_string_finder(struct string_finder_tv *tv)
  * The program will move into this directory.
  */
 #define INPUTS_DIR	"single_test_files"
+/* the number of ways of reading files, besides choosing by size */
+#define N_FORCED_IO_METHODS	2
+/*
+ * the number of ways of reading and scanning files:
+ * the default, then every way of reading with every set of kernels,
+ * which must all give the same output
+ */
+#define N_TEST_ENGINES		(1 + N_FORCED_IO_METHODS * N_KERNEL_LEVELS)
+/*
+ * Get the way of reading and scanning files for a round of the tests.
+ * engine_i:	the round, from 0 to "N_TEST_ENGINES" - 1
+ * engine:	stores the way of reading and scanning files
+ */
+static void get_test_engine(unsigned engine_i, struct test_engine *engine)
+{
+	engine->io_method = AUTO_IO;
+	engine->force_kernels = engine_i > 0;
+	engine->kernel_level = SCALAR_KERNELS;
+	if (engine_i > 0) {
+		engine->io_method = (engine_i - 1) / N_KERNEL_LEVELS == 0 ?
+				    READ_IO : MMAP_IO;
+		engine->kernel_level = (engine_i - 1) % N_KERNEL_LEVELS;
+	}
+}
+
 /*
- * Move into the directory containing all the test inputs, and run the tests.
+ * Move into the directory containing all the test inputs, and run the tests
+ * with every way of reading and scanning files that this machine supports.
+ * returns	the number of failed tests
  */
-static void test_string_finders()
+static unsigned test_string_finders()
 {
 	unsigned n_failures;
-	unsigned tv_i;
+	unsigned n_tests;
+	unsigned engine_i;
 
 	if (chdir(INPUTS_DIR)) {
 		printlg(ERROR_LEVEL, "Failed to switch to directory %s.\n",
@@ -135,10 +184,156 @@ static void test_string_finders()
 	}
 
 	n_failures = 0;
+	n_tests = 0;
+
+	for (engine_i = 0; engine_i < N_TEST_ENGINES; engine_i++) {
+		struct test_engine engine;
+		unsigned tv_i;
+
+		get_test_engine(engine_i, &engine);
+		if (engine.force_kernels &&
+		    get_scan_kernels(engine.kernel_level) == NULL) {
+			continue;
+		}
+
+		for (tv_i = 0; tv_i < N_STRING_FINDER_TVS; tv_i++) {
+			printlg(INFO_LEVEL,
+				"Running string finder test %u with engine "
+				"%u.\n", tv_i, engine_i);
+			n_tests++;
+			if (test_string_finder(string_finder_tvs[tv_i],
+					       &engine)) {
+				printlg(INFO_LEVEL, "Passed!\n");
+			} else {
+				printlg(ERROR_LEVEL, "Failed!\n");
+				n_failures++;
+			}
+		}
+	}
+
+	if (n_failures > 0) {
+		printlg(ERROR_LEVEL, "Failed %u / %u tests!\n",
+			n_failures, n_tests);
+	}
+	return n_failures;
+}
+
+/* a configuration of the engine thresholds, and whether it is valid */
+struct engine_config_tv {
+	/*
+	 * the configuration, in which "%s" is replaced by
+	 * the name of the kernels given by "kernels_offset"
+	 */
+	const char *text;
+	/*
+	 * the level of the kernels named in the configuration,
+	 * counting up from the widest supported kernels,
+	 * and wrapping around
+	 */
+	unsigned kernels_offset;
+	/* Should the configuration be accepted? */
+	int valid;
+};
+
+/* the configuration settings other than "kernels" */
+#define CONFIG_MMAP_SIZE	"min_mmap_size 65536\n"
+#define CONFIG_VECTOR_SIZE	"min_vector_size 64\n"
+#define CONFIG_VECTOR_LEVEL	"vector_level scalar\n"
+/* the tests of "read_engine_config" */
+static const struct engine_config_tv engine_config_tvs[] = {
+	/* a complete configuration, with a comment */
+	{"# comment\nkernels %s\n" CONFIG_MMAP_SIZE CONFIG_VECTOR_SIZE
+	 CONFIG_VECTOR_LEVEL, 0, 1},
+	/* a missing setting */
+	{"kernels %s\n" CONFIG_MMAP_SIZE CONFIG_VECTOR_LEVEL, 0, 0},
+	/* an unknown setting */
+	{"kernels %s\n" CONFIG_MMAP_SIZE CONFIG_VECTOR_SIZE
+	 CONFIG_VECTOR_LEVEL "min_other_size 1\n", 0, 0},
+	/* measured on a machine with other kernels */
+	{"kernels %s\n" CONFIG_MMAP_SIZE CONFIG_VECTOR_SIZE
+	 CONFIG_VECTOR_LEVEL, 1, 0},
+	/* a negative size */
+	{"kernels %s\nmin_mmap_size -1\n" CONFIG_VECTOR_SIZE
+	 CONFIG_VECTOR_LEVEL, 0, 0},
+};
+#define N_ENGINE_CONFIG_TVS	(sizeof(engine_config_tvs) / \
+				 sizeof(*engine_config_tvs))
+
+/*
+ * Check that "read_engine_config" accepts a configuration,
+ * and stores the thresholds in it, only if it is valid,
+ * leaving the thresholds untouched otherwise.
+ * tv:		the configuration to read
+ * returns	1 if passed, 0 otherwise
+ */
+static int test_engine_config(const struct engine_config_tv *tv)
+{
+	enum scan_kernel_level kernels = (best_scan_kernel_level() +
+					  tv->kernels_offset) %
+					 N_KERNEL_LEVELS;
+	struct engine_thresholds thresholds = {1, 1, SSE2_KERNELS};
+	FILE *config = tmpfile();
+	int error;
 
-	for (tv_i = 0; tv_i < N_STRING_FINDER_TVS; tv_i++) {
-		printlg(INFO_LEVEL, "Running string finder test %u.\n", tv_i);
-		if (test_string_finder(string_finder_tvs[tv_i])) {
+	if (config == NULL) {
+		printlg(ERROR_LEVEL,
+			"Failed to open temporary file to store config.\n");
+		return 0;
+	}
+	fprintf(config, tv->text, kernel_level_name(kernels));
+	rewind(config);
+	error = read_engine_config(&thresholds, config);
+	fclose(config);
+
+	if (tv->valid) {
+		return !error && thresholds.min_mmap_size == 65536 &&
+		       thresholds.min_vector_size == 64 &&
+		       thresholds.vector_level == SCALAR_KERNELS;
+	}
+	return error && thresholds.min_mmap_size == 1 &&
+	       thresholds.min_vector_size == 1 &&
+	       thresholds.vector_level == SSE2_KERNELS;
+}
+
+/*
+ * Check that thresholds saved by "write_engine_config"
+ * are loaded again by "read_engine_config".
+ * returns	1 if passed, 0 otherwise
+ */
+static int test_engine_config_round_trip(void)
+{
+	struct engine_thresholds saved = {12345, 678, SCALAR_KERNELS};
+	struct engine_thresholds loaded;
+	FILE *config = tmpfile();
+	int error;
+
+	if (config == NULL) {
+		printlg(ERROR_LEVEL,
+			"Failed to open temporary file to store config.\n");
+		return 0;
+	}
+	error = write_engine_config(&saved, config);
+	rewind(config);
+	error = error || read_engine_config(&loaded, config);
+	fclose(config);
+
+	return !error && loaded.min_mmap_size == saved.min_mmap_size &&
+	       loaded.min_vector_size == saved.min_vector_size &&
+	       loaded.vector_level == saved.vector_level;
+}
+
+/*
+ * Run the tests of reading and writing the engine thresholds.
+ * returns	the number of failed tests
+ */
+static unsigned test_engine_configs(void)
+{
+	unsigned n_failures = 0;
+	unsigned tv_i;
+
+	for (tv_i = 0; tv_i < N_ENGINE_CONFIG_TVS; tv_i++) {
+		printlg(INFO_LEVEL, "Running engine config test %u.\n", tv_i);
+		if (test_engine_config(engine_config_tvs + tv_i)) {
 			printlg(INFO_LEVEL, "Passed!\n");
 		} else {
 			printlg(ERROR_LEVEL, "Failed!\n");
@@ -146,17 +341,24 @@ static void test_string_finders()
 		}
 	}
 
-	if (n_failures > 0) {
-		printlg(ERROR_LEVEL, "Failed %u / %u tests!\n",
-			n_failures, N_STRING_FINDER_TVS);
+	printlg(INFO_LEVEL, "Running engine config round trip test.\n");
+	if (test_engine_config_round_trip()) {
+		printlg(INFO_LEVEL, "Passed!\n");
 	} else {
-		printlg(INFO_LEVEL, "All tests passed!\n");
+		printlg(ERROR_LEVEL, "Failed!\n");
+		n_failures++;
 	}
+	return n_failures;
 }
 
 int main(void)
 {
-	test_string_finders();
+	unsigned n_failures = test_string_finders();
+
+	n_failures += test_engine_configs();
+	if (n_failures == 0) {
+		printlg(INFO_LEVEL, "All tests passed!\n");
+	}
 
 	return 0;
 }